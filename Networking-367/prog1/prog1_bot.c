@@ -0,0 +1,279 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "prog1_net.h"
+#include "prog1_session.h"
+
+#define BOT_MAX_THREADS 64
+#define BOT_EVENTS 256 /* epoll events handled per wakeup */
+
+/*------------------------------------------------------------------------
+* Bot front end for the client: a load generator.
+*
+* Opens the given number of sessions to one server and plays them all at
+* once, split over a few threads that each run an epoll loop over their
+* share of the sessions. Consecutive sessions end up paired against each
+* other by the lobby. Bots drop a token in a random column that still has
+* room. Nothing is drawn, a summary is printed once every game is over.
+*------------------------------------------------------------------------
+*/
+
+struct bot_session {
+	struct session game;
+	int events; /* what epoll is watching for */
+};
+
+struct bot_thread {
+	pthread_t tid;
+	struct bot_session * bots;
+	int count;
+	unsigned int seed;
+	int wins;
+	int losses;
+	int ties;
+	int dropped; /* connections that closed before the game ended */
+	long moves;
+};
+
+static void bot_status(struct session * s, char status);
+static void * bot_thread_main(void * arg);
+
+//Runs the bots
+//Take in the client's command line, starting with --bot
+//returns the exit status
+int bot_main(int argc, char **argv)
+{
+	struct bot_thread threads[BOT_MAX_THREADS];
+	struct bot_session * bots;
+	struct sockaddr_in sad;
+	struct rlimit limit;
+	struct pollfd pfd;
+	struct timespec start;
+	struct timespec connected; /* every session is in, play starts */
+	struct timespec end;
+	double connect_seconds;
+	double seconds;
+	int sessions;
+	int nthreads = 1;
+	int wins = 0, losses = 0, ties = 0, dropped = 0;
+	long moves = 0;
+	int sd;
+	int i;
+
+	if (argc != 5 && argc != 6) {
+		fprintf(stderr,"Error: Wrong number of arguments\n");
+		fprintf(stderr,"usage:\n");
+		fprintf(stderr,"./client --bot server_address server_port sessions [threads]\n");
+		exit(EXIT_FAILURE);
+	}
+	sessions = atoi(argv[4]);
+	if (argc == 6)
+	{
+		nthreads = atoi(argv[5]);
+	}
+	if (sessions <= 0 || sessions % 2 != 0) {
+		fprintf(stderr,"Error: sessions must be even so every bot has an opponent\n");
+		exit(EXIT_FAILURE);
+	}
+	if (nthreads <= 0 || nthreads > BOT_MAX_THREADS) {
+		fprintf(stderr,"Error: threads must be 1 to %d\n", BOT_MAX_THREADS);
+		exit(EXIT_FAILURE);
+	}
+	if (nthreads > sessions)
+	{
+		nthreads = sessions;
+	}
+
+	// One socket per session, take every descriptor we're allowed
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	resolve_server(argv[2], argv[3], &sad);
+	bots = calloc(sessions, sizeof(struct bot_session));
+	if (bots == NULL) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	memset(threads, 0, sizeof(threads));
+	for (i = 0; i < nthreads; i++)
+	{
+		threads[i].bots = bots + (long)sessions * i / nthreads;
+		threads[i].count = (int)((long)sessions * (i + 1) / nthreads - (long)sessions * i / nthreads);
+		threads[i].seed = (unsigned int)(start.tv_nsec + i);
+	}
+	for (i = 0; i < sessions; i++)
+	{
+		if ((sd = connect_server(&sad)) < 0) {
+			exit(EXIT_FAILURE);
+		}
+		session_init(&bots[i].game, sd, bot_status, &threads[(long)i * nthreads / sessions]);
+
+		// Wait for the lobby to take this one before the next, the listen backlog is short
+		pfd.fd = sd;
+		pfd.events = POLLIN;
+		while (bots[i].game.game_type == 0)
+		{
+			if ((poll(&pfd, 1, -1) < 0 && errno != EINTR) || !session_read(&bots[i].game)) {
+				fprintf(stderr, "Error: Server closed the connection\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	// Play time only, moves/s shouldn't count the connects
+	clock_gettime(CLOCK_MONOTONIC, &connected);
+	connect_seconds = (connected.tv_sec - start.tv_sec) + (connected.tv_nsec - start.tv_nsec) / 1e9;
+	for (i = 0; i < nthreads; i++)
+	{
+		pthread_create(&threads[i].tid, NULL, bot_thread_main, &threads[i]);
+	}
+	for (i = 0; i < nthreads; i++)
+	{
+		pthread_join(threads[i].tid, NULL);
+		wins += threads[i].wins;
+		losses += threads[i].losses;
+		ties += threads[i].ties;
+		dropped += threads[i].dropped;
+		moves += threads[i].moves;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = (end.tv_sec - connected.tv_sec) + (end.tv_nsec - connected.tv_nsec) / 1e9;
+
+	printf("bot: %d sessions on %d threads, %d games over (%d won, %d lost, %d tied), %d dropped\n",
+		sessions, nthreads, wins + losses + ties, wins, losses, ties, dropped);
+	printf("bot: connected in %.3f s, %ld moves in %.3f s of play, %.0f moves/s\n", connect_seconds, moves, seconds, moves / seconds);
+	free(bots);
+	return (dropped == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//Plays a bot's side of the game
+//Take in the session and the server's status byte
+//returns nothing
+static void bot_status(struct session * s, char status)
+{
+	struct bot_thread * thread = s->user;
+	char move[2];
+	int col = 0;
+	int tries;
+
+	if (status == 'Y' || status == 'I')
+	{
+		for (tries = 0; tries < 16; tries++)
+		{
+			col = rand_r(&thread->seed) % 7;
+			if (s->game_board[col] == '0')
+			{
+				break; //top cell free so the column has room
+			}
+		}
+		move[0] = 'A';
+		move[1] = (char)('0' + col);
+		if (session_move(s, move) == 1)
+		{
+			thread->moves++;
+		}
+	}
+	else if (status == 'W')
+	{
+		thread->wins++;
+	}
+	else if (status == 'L')
+	{
+		thread->losses++;
+	}
+	else if (status == 'T')
+	{
+		thread->ties++;
+	}
+}
+
+//One bot thread, an epoll loop over its share of the sessions
+//Take in the thread's bot_thread
+//returns NULL once all of its games are over
+static void * bot_thread_main(void * arg)
+{
+	struct bot_thread * thread = arg;
+	struct epoll_event events[BOT_EVENTS];
+	struct epoll_event ev;
+	struct bot_session * bot;
+	int open = thread->count;
+	int epfd;
+	int want;
+	int n;
+	int i;
+
+	epfd = epoll_create1(0);
+	if (epfd < 0) {
+		perror("epoll_create1");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < thread->count; i++)
+	{
+		bot = &thread->bots[i];
+		bot->events = EPOLLIN;
+		ev.events = bot->events;
+		ev.data.ptr = bot;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, bot->game.sd, &ev);
+	}
+
+	while (open > 0)
+	{
+		n = epoll_wait(epfd, events, BOT_EVENTS, -1);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			perror("epoll_wait");
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < n; i++)
+		{
+			bot = events[i].data.ptr;
+			if ((events[i].events & EPOLLOUT) && !session_write(&bot->game))
+			{
+				events[i].events |= EPOLLERR;
+			}
+			if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			{
+				if (!session_read(&bot->game))
+				{
+					if (!bot->game.over)
+					{
+						thread->dropped++;
+					}
+					epoll_ctl(epfd, EPOLL_CTL_DEL, bot->game.sd, NULL);
+					close(bot->game.sd);
+					open--;
+					continue;
+				}
+			}
+			want = EPOLLIN | ((bot->game.out_len > 0) ? EPOLLOUT : 0);
+			if (want != bot->events)
+			{
+				bot->events = want;
+				ev.events = want;
+				ev.data.ptr = bot;
+				epoll_ctl(epfd, EPOLL_CTL_MOD, bot->game.sd, &ev);
+			}
+		}
+	}
+	close(epfd);
+	return NULL;
+}
@@ -6,13 +6,27 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include "prog1_net.h"
+#include "prog1_render.h"
+#include "prog1_session.h"
 
 /*------------------------------------------------------------------------
 * Program: client
 *
 * Purpose: allocate a socket, connect to a server, and print all output
 *
+* The keyboard and the server are watched together, so the server is
+* answered while the user is typing and anything typed out of turn is
+* dropped instead of going out as a stale move. Premoves ("QA3A4") can be
+* made at any time, ones made on the user's own turn are held until their
+* move has gone out. With --bot the same session code runs many headless
+* games at once as a load generator (see prog1_bot.c).
+*
 * Syntax: client [ host [port] ]
+*         client --bot host port sessions [ threads ]
 *
 * host - name of a computer on which server is executing
 * port - protocol port number server is using
@@ -27,217 +41,237 @@
 */
 
 //Prototypes
-void print_board(char * game_board); 
-void game_main (char * game_board, int sd);
+void game_main(int sd);
+void show_status(struct session * s, char status);
+void handle_line(struct session * s, char * line);
+int bot_main(int argc, char **argv);
+
+struct render screen; /* everything the user sees goes through here */
 
 
-main( int argc, char **argv) {
-	struct hostent *ptrh; 	/* pointer to a host table entry */
-	struct protoent *ptrp; 	/* pointer to a protocol table entry */
+int main( int argc, char **argv) {
 	struct sockaddr_in sad; 	/* structure to hold an IP address */
 	int sd; 					/* socket descriptor */
-	int port; 				/* protocol port number */
-	char *host; 				/* pointer to host name */
-	int n; 					/* number of characters read */
-	char severResponse[1]; 	/* buffer for data from the server */
-	char game_board[47];
 
-	memset((char *)&sad,0,sizeof(sad)); /* clear sockaddr structure */
-	sad.sin_family = AF_INET; /* set family to Internet */
+	if (argc > 1 && strcmp(argv[1], "--bot") == 0)
+	{
+		return bot_main(argc, argv);
+	}
 
 	if( argc != 3 ) {
 		fprintf(stderr,"Error: Wrong number of arguments\n");
 		fprintf(stderr,"usage:\n");
 		fprintf(stderr,"./client server_address server_port\n");
+		fprintf(stderr,"./client --bot server_address server_port sessions [threads]\n");
 		exit(EXIT_FAILURE);
 	}
 
-	port = atoi(argv[2]); /* convert to binary */
-	if (port > 0) /* test for legal value */
-	sad.sin_port = htons((u_short)port);
-	else {
-		fprintf(stderr,"Error: bad port number %s\n",argv[2]);
-		exit(EXIT_FAILURE);
-	}
-
-	host = argv[1]; /* if host argument specified */
-
-	/* Convert host name to equivalent IP address and copy to sad. */
-	ptrh = gethostbyname(host);
-	if ( ptrh == NULL ) {
-		fprintf(stderr,"Error: Invalid host: %s\n", host);
-		exit(EXIT_FAILURE);
-	}
-
-	memcpy(&sad.sin_addr, ptrh->h_addr, ptrh->h_length);
-
-	/* Map TCP transport protocol name to protocol number. */
-	if ( ((long int)(ptrp = getprotobyname("tcp"))) == 0) {
-		fprintf(stderr, "Error: Cannot map \"tcp\" to protocol number");
-		exit(EXIT_FAILURE);
-	}
-
-	/* Create a socket. */
-	sd = socket(PF_INET, SOCK_STREAM, ptrp->p_proto);
+	resolve_server(argv[1], argv[2], &sad);
+	sd = connect_server(&sad);
 	if (sd < 0) {
-		fprintf(stderr, "Error: Socket creation failed\n");
-		exit(EXIT_FAILURE);
-	}
-
-	/* Connect the socket to the specified server. */
-	if (connect(sd, (struct sockaddr *)&sad, sizeof(sad)) < 0) {
-		fprintf(stderr,"connect failed\n");
 		exit(EXIT_FAILURE);
 	}
 
-	char guessbuf[100];
-	unsigned int guess[1];
-
-	//Receive Game Type and Tell User Type
-	char gameType;
-	recv(sd, &gameType, sizeof(gameType), 0);
-	if (gameType == 'S')
-	{
-		printf("Game Type is Standard\n");
-	}
-	else if (gameType == 'P')
-	{
-		printf("Game Type is Popout\n");
-	}
-	else if (gameType == 'K')
-	{
-		printf("Game Type is Antistack\n");  
-	}
-	else 
-	{
-		printf("Not Support Game Type! ERROR");  
-		exit(EXIT_FAILURE);
-	}
+	render_init(&screen, STDOUT_FILENO);
+	game_main(sd);
 
-	//Get next char from server
-	char nextServerResponse;
-	recv(sd, &nextServerResponse, sizeof(nextServerResponse), 0);
-	if (nextServerResponse == '2') //player 1
-	{
-		printf("Hi Player One! We're waiting for player two to connect. Game will begin soon!\n");
-		game_main(game_board, sd);
-	}
-	else if (nextServerResponse == 'H') //player 2
-	{
-		//Greet Player 2
-		printf("Hi Player Two! Player One will go first!\n");
-		//receive and print game board
-		recv(sd, &game_board, 42, MSG_WAITALL);
-		print_board(game_board);
-		printf("Please Wait For Your Turn\n");
-		game_main(game_board, sd);
-	} 
 	// Game finished, clean up
+	render_flush(&screen);
 	close(sd);
 	exit(EXIT_SUCCESS);
 } //end of Main
 
 //Main Game Logic
-void game_main (char * game_board, int sd)
+//Waits on the server and the keyboard together until the game is over
+//In : server socket
+//Return: none
+void game_main(int sd)
 {
-		char PlayerMove[100];
-		int go = 1;
-		char playerStatus;
-		while (go == 1)
+	struct session game;
+	struct pollfd pfds[2];
+	char line[100];
+	int line_len = 0;
+	char * newline;
+	int echoed = isatty(STDIN_FILENO); /* terminal shows what's typed under the board */
+	int n;
+
+	session_init(&game, sd, show_status, NULL);
+	pfds[1].fd = STDIN_FILENO;
+	while (1)
+	{
+		render_flush(&screen);
+		pfds[0].fd = sd;
+		pfds[0].events = POLLIN | ((game.out_len > 0) ? POLLOUT : 0);
+		pfds[1].events = POLLIN;
+		if (poll(pfds, 2, -1) < 0)
 		{
-			//Wait for Player's Turn
-			recv(sd, &playerStatus, 1, 0);
-			if (playerStatus == 'Y')
+			if (errno == EINTR)
 			{
-				//Player's Turn
-				printf("\nIt's your Turn!\n");
-				//Get Game Board
-				recv(sd, game_board, 42, MSG_WAITALL);
-				//print Game Board
-				print_board(game_board);
-				//Get Move From User
-				printf("\nPlease Enter Your Move: ");
-				fgets(PlayerMove, 100, stdin);
-				send(sd, &PlayerMove, 2, 0);
-				//receive response from server
-				recv(sd, &playerStatus, 1, 0);
-				while (playerStatus == 'I')
-				{
-					printf("Invalid move or bad syntax. Please try again\n");
-					printf("\nPlease Enter Your Move: ");
-					fgets(PlayerMove, 100, stdin);
-					send(sd, &PlayerMove, 2, 0); //Send new move to server
-					recv(sd, &playerStatus, 1, 0);
-				}
-				if (playerStatus == 'H')
-				{
-					//Wait for other player move
-					printf("\nPlease wait for your turn\n");
-					recv(sd, game_board, 42, MSG_WAITALL);
-					print_board(game_board);	
-				}
-				else if (playerStatus == 'W')
-				{
-					printf("Congrats! You Win the Game!\n");
-					go = 0;
-					break;
-				}
-				else if (playerStatus == 'L')
-				{
-					printf("Sorry, you lost the game. Better Luck Next Time!\n");
-					go = 0;
-					break;
-				}
-				else if (playerStatus == 'T')
-				{
-					printf("It's a tie! Good job, but next time do better!:) \n");
-					go = 0;
-					break;
-				}
-			}//handle case when it wasn't your turn and other player just one
-			else if (playerStatus == 'W')
+				continue;
+			}
+			break;
+		}
+
+		if (pfds[0].revents & POLLOUT)
+		{
+			session_write(&game);
+		}
+		if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR))
+		{
+			if (!session_read(&game))
 			{
-				printf("Congrats! You Win the Game!\n");
-				go = 0;
 				break;
 			}
-			else if (playerStatus == 'L')
+		}
+		if (pfds[1].revents)
+		{
+			n = read(STDIN_FILENO, line + line_len, sizeof(line) - 1 - line_len);
+			if (n <= 0)
 			{
-				printf("Sorry, you lost the game. Better Luck Next Time!\n");
-				go = 0;
-				break;
+				pfds[1].fd = -1; //no more input, keep following the game
+				continue;
 			}
-			else if (playerStatus == 'T')
+			line_len += n;
+			line[line_len] = '\0';
+			while ((newline = strchr(line, '\n')) != NULL || line_len == sizeof(line) - 1)
 			{
-				printf("It's a Tie! Good job, but next time do better! :)\n");
-				go = 0;
-				break;
+				if (newline == NULL)
+				{
+					newline = line + line_len - 1; //overlong line, take it as is
+				}
+				*newline = '\0';
+				if (echoed)
+				{
+					render_typed(&screen);
+				}
+				handle_line(&game, line);
+				line_len -= newline + 1 - line;
+				memmove(line, newline + 1, line_len + 1);
 			}
-		} 
+		}
+	}
 }
 
-
-//Print Game Board
-//In : Game_board
+//Shows the user each message from the server
+//In : session and the server's status byte
 //Return: none
-//Output: Display passed in game board
-void print_board(char * game_board)
+void show_status(struct session * s, char status)
 {
-	int i;
-	for (i = 0; i < 42; i++)
+	static int greeted = 0;
+
+	if (status == 'S')
 	{
-		if ( i % 7 == 0 && i != 0)
+		render_title(&screen, "Game Type is Standard");
+	}
+	else if (status == 'P')
+	{
+		render_title(&screen, "Game Type is Popout");
+	}
+	else if (status == 'K')
+	{
+		render_title(&screen, "Game Type is Antistack");
+	}
+	else if (status == '2') //player 1
+	{
+		render_text(&screen, "Hi Player One! We're waiting for player two to connect. Game will begin soon!\n");
+		greeted = 1;
+	}
+	else if (status == 'Y')
+	{
+		render_board(&screen, s->game_board);
+		render_text(&screen, "\nIt's your Turn!\n");
+		render_text(&screen, "\nPlease Enter Your Move: ");
+	}
+	else if (status == 'H')
+	{
+		render_board(&screen, s->game_board);
+		if (!greeted) //player 2
 		{
-			printf("\n");
+			render_text(&screen, "Hi Player Two! Player One will go first!\n");
+			render_text(&screen, "Please Wait For Your Turn\n");
+			greeted = 1;
 		}
-		printf(" %c ", game_board[i]);
-		fflush(stdout);
-		sync();
-	}	
-	printf("\n");
-	printf("---------------------\n");
-	printf(" 0  1  2  3  4  5  6\n");
+		else
+		{
+			render_text(&screen, "\nPlease wait for your turn\n");
+		}
+	}
+	else if (status == 'I')
+	{
+		render_text(&screen, "Invalid move or bad syntax. Please try again\n");
+		render_text(&screen, "\nPlease Enter Your Move: ");
+	}
+	else if (status == 'E')
+	{
+		render_text(&screen, "Hint: %c%c (eval %d)\n", s->hint[0], s->hint[1], s->hint_eval);
+		render_text(&screen, "\nPlease Enter Your Move: ");
+	}
+	else if (status == 'R')
+	{
+		render_text(&screen, "Your premove %c%c couldn't be played\n", s->premove_failed[0], s->premove_failed[1]);
+	}
+	else if (status == 'W')
+	{
+		render_text(&screen, "Congrats! You Win the Game!\n");
+	}
+	else if (status == 'L')
+	{
+		render_text(&screen, "Sorry, you lost the game. Better Luck Next Time!\n");
+	}
+	else if (status == 'T')
+	{
+		render_text(&screen, "It's a Tie! Good job, but next time do better! :)\n");
+	}
 }
 
+//Acts on a line the user typed
+//Premoves ("QA3A4": if they play A3, play A4) can be made at any time, ones made
+//on the user's turn go out after their move; moves and hint requests ("?") only on the user's turn
+//In : session and the line without its newline
+//Return: none
+void handle_line(struct session * s, char * line)
+{
+	char move[2];
+	int sent;
 
-
+	if (line[0] == 'Q')
+	{
+		if (strlen(line) < 5)
+		{
+			render_text(&screen, "Premoves look like QA3A4\n");
+		}
+		else if ((sent = session_premove(s, line)) == 1)
+		{
+			render_text(&screen, "Premove queued\n");
+		}
+		else if (sent == 0)
+		{
+			render_text(&screen, "Premove held, it goes out after your move\n");
+		}
+		else
+		{
+			render_text(&screen, "Too many premoves waiting, that one was dropped\n");
+		}
+	}
+	else if (!s->my_turn)
+	{
+		render_text(&screen, "Not your turn yet, that was ignored. Premoves (QA3A4) can be sent any time.\n");
+		return;
+	}
+	else if (line[0] == '?')
+	{
+		session_ask_hint(s);
+		return;
+	}
+	else
+	{
+		move[0] = line[0];
+		move[1] = (line[0] != '\0') ? line[1] : '\0';
+		session_move(s, move);
+		return;
+	}
+	if (s->my_turn)
+	{
+		render_text(&screen, "\nPlease Enter Your Move: ");
+	}
+}
@@ -0,0 +1,25 @@
+#ifndef PROG1_CLUSTER_H
+#define PROG1_CLUSTER_H
+
+/*------------------------------------------------------------------------
+* Messages between the coordinator and server nodes.
+*
+* Nodes connect to the coordinator's Unix socket (SOCK_SEQPACKET so each
+* message arrives whole). The coordinator pairs players itself and hands
+* both sockets to a node with SCM_RIGHTS in a CLUSTER_GAME message. Nodes
+* send CLUSTER_LOAD whenever a game starts or ends.
+*------------------------------------------------------------------------
+*/
+
+#define CLUSTER_GAME 'G' /* coordinator -> node, carries both player sockets */
+#define CLUSTER_LOAD 'L' /* node -> coordinator */
+
+struct cluster_msg {
+	char kind;
+	char game_type; /* CLUSTER_GAME: game type for the pair */
+	int game_id; /* CLUSTER_GAME: coordinator's number for the game */
+	int live_games; /* CLUSTER_LOAD: games the node is running */
+	int games_started; /* CLUSTER_LOAD: games the node has ever started */
+};
+
+#endif
@@ -0,0 +1,403 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "prog1_net.h"
+#include "prog1_cluster.h"
+
+#define MAX_LOBBIES 8 /* lobby ports */
+#define MAX_NODES 64 /* server nodes connected at once */
+#define MAX_PENDING 64 /* pairs held while no node is connected */
+
+/*------------------------------------------------------------------------
+* Program: coordinator
+*
+* Purpose: matchmaking front end for several server nodes
+* (1) accept players on one lobby port per game type
+* (2) pair them up the same way a standalone server does
+* (3) pass both player sockets to the node running the fewest games
+* (4) go back to step (1)
+*
+* Nodes are started separately with ./server --node node_socket and can
+* join or leave at any time. Each pairing decision is logged with the
+* load of every node when it was made, as are nodes joining and leaving
+* and every change a node reports. A node that stops reading is dropped
+* rather than let it hold up the lobbies.
+* Players only ever talk to the node, the coordinator is out of the path
+* once the sockets are handed over.
+*
+* Syntax: coordinator [ node socket ] [ port:game type ] ...
+*
+* node socket - path of the Unix socket nodes connect to
+* port:game type - lobby port and the game played there, e.g. 9000:standard
+*
+*------------------------------------------------------------------------
+*/
+
+struct lobby {
+	int sd; /* listening socket */
+	char game_type;
+	int waiting; /* player one socket while they wait for an opponent, -1 if none */
+};
+
+struct node {
+	int sd; /* Unix socket to the node */
+	int id; /* number used in the log */
+	int live_games; /* last reported, plus games handed over since */
+};
+
+struct pair {
+	int players[2];
+	char game_type;
+	int game_id;
+};
+
+struct lobby lobbies[MAX_LOBBIES];
+int lobby_count;
+struct node nodes[MAX_NODES];
+int node_count;
+int next_node_id;
+struct pair pending[MAX_PENDING];
+int pending_count;
+int next_game_id;
+
+// Protos
+int open_node_listener(char * path);
+void lobby_accept(struct lobby * lobby);
+void dispatch(struct pair * pair);
+void node_join(int node_sd);
+void node_message(int index);
+void node_leave(int index);
+void log_loads(int chosen);
+char * game_name(char game_type);
+
+// Main
+int main(int argc, char **argv) {
+	struct pollfd pfds[MAX_LOBBIES + 1 + MAX_NODES];
+	int node_sd; /* Unix socket nodes connect to */
+	char * colon;
+	int n;
+	int i;
+
+	if (argc < 3 || argc - 2 > MAX_LOBBIES) {
+		fprintf(stderr,"Error: Wrong number of arguments\n");
+		fprintf(stderr,"usage:\n");
+		fprintf(stderr,"./coordinator node_socket port:game_type [port:game_type ...]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Players that hang up mid greeting shouldn't take the coordinator down
+	signal(SIGPIPE, SIG_IGN);
+
+	for (i = 2; i < argc; i++)
+	{
+		colon = strchr(argv[i], ':');
+		if (colon == NULL)
+		{
+			fprintf(stderr,"Error: Expected port:game_type, got %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		*colon = '\0';
+		if (strcmp(colon + 1, "standard") == 0)
+		{
+			lobbies[lobby_count].game_type = 'S';
+		}
+		else if (strcmp(colon + 1, "popout") == 0)
+		{
+			lobbies[lobby_count].game_type = 'P';
+		}
+		else if (strcmp(colon + 1, "antistack") == 0)
+		{
+			lobbies[lobby_count].game_type = 'K';
+		}
+		else
+		{
+			printf("Game Type Not Supported! Exit!");
+			exit(EXIT_FAILURE);
+		}
+		lobbies[lobby_count].sd = open_listener(argv[i]);
+		lobbies[lobby_count].waiting = -1;
+		lobby_count++;
+	}
+	node_sd = open_node_listener(argv[1]);
+
+	/* Main coordinator loop - lobbies, nodes joining and node reports */
+	while (1)
+	{
+		for (i = 0; i < lobby_count; i++)
+		{
+			pfds[i].fd = lobbies[i].sd;
+			pfds[i].events = POLLIN;
+		}
+		pfds[lobby_count].fd = node_sd;
+		pfds[lobby_count].events = POLLIN;
+		for (i = 0; i < node_count; i++)
+		{
+			pfds[lobby_count + 1 + i].fd = nodes[i].sd;
+			pfds[lobby_count + 1 + i].events = POLLIN;
+		}
+		n = lobby_count + 1 + node_count;
+		if (poll(pfds, n, -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			perror("poll");
+			exit(EXIT_FAILURE);
+		}
+
+		// Node reports first, walking backwards since a node leaving shuffles the array
+		for (i = node_count - 1; i >= 0; i--)
+		{
+			if (pfds[lobby_count + 1 + i].revents)
+			{
+				node_message(i);
+			}
+		}
+		if (pfds[lobby_count].revents & POLLIN)
+		{
+			node_join(node_sd);
+		}
+		for (i = 0; i < lobby_count; i++)
+		{
+			if (pfds[i].revents & POLLIN)
+			{
+				lobby_accept(&lobbies[i]);
+			}
+		}
+	}
+}
+
+//Creates the Unix socket nodes connect to, replacing any stale one
+//Take in the socket path
+//returns the listening socket, exits on failure
+int open_node_listener(char * path)
+{
+	struct sockaddr_un addr;
+	int sd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	unlink(path);
+	sd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (sd < 0) {
+		fprintf(stderr, "Error: Socket creation failed\n");
+		exit(EXIT_FAILURE);
+	}
+	if (bind(sd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr,"Error: Bind failed for %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+	if (listen(sd, QLEN) < 0) {
+		fprintf(stderr,"Error: Listen failed\n");
+		exit(EXIT_FAILURE);
+	}
+	return sd;
+}
+
+//Accepts a player into a lobby, pairing them if someone is already waiting
+//Take in the lobby with a connection ready
+//returns nothing
+void lobby_accept(struct lobby * lobby)
+{
+	struct pair pair;
+	char playerNumber = '2';
+	int player;
+
+	if ((player = accept(lobby->sd, NULL, NULL)) < 0) {
+		fprintf(stderr, "Error: Accept failed\n");
+		return;
+	}
+	send(player, &lobby->game_type, 1, 0);
+	if (lobby->waiting < 0)
+	{
+		//Guest 1
+		send(player, &playerNumber, 1, 0);
+		lobby->waiting = player;
+		return;
+	}
+
+	//Guest 2
+	pair.players[0] = lobby->waiting;
+	pair.players[1] = player;
+	pair.game_type = lobby->game_type;
+	pair.game_id = next_game_id++;
+	lobby->waiting = -1;
+	dispatch(&pair);
+}
+
+//Hands a pair to the node with the fewest live games
+//Pairs are held until a node joins if there are none
+//Take in the pair
+//returns nothing
+void dispatch(struct pair * pair)
+{
+	struct cluster_msg msg;
+	int best;
+	int i;
+
+	while (node_count > 0)
+	{
+		best = 0;
+		for (i = 1; i < node_count; i++)
+		{
+			if (nodes[i].live_games < nodes[best].live_games)
+			{
+				best = i;
+			}
+		}
+		memset(&msg, 0, sizeof(msg));
+		msg.kind = CLUSTER_GAME;
+		msg.game_type = pair->game_type;
+		msg.game_id = pair->game_id;
+		if (send_fds(nodes[best].sd, &msg, sizeof(msg), pair->players, 2) < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				printf("node %d stopped reading, dropping it\n", nodes[best].id);
+			}
+			node_leave(best);
+			continue; //try the next least loaded node
+		}
+		printf("game %d (%s) -> node %d, loads", pair->game_id, game_name(pair->game_type), nodes[best].id);
+		log_loads(best);
+		nodes[best].live_games++; //until the node reports back
+		close(pair->players[0]);
+		close(pair->players[1]);
+		return;
+	}
+
+	if (pending_count == MAX_PENDING)
+	{
+		printf("game %d (%s) dropped, no nodes and %d games already waiting\n", pair->game_id, game_name(pair->game_type), pending_count);
+		fflush(stdout);
+		close(pair->players[0]);
+		close(pair->players[1]);
+		return;
+	}
+	printf("game %d (%s) held, no nodes\n", pair->game_id, game_name(pair->game_type));
+	fflush(stdout);
+	pending[pending_count++] = *pair;
+}
+
+//Accepts a new node and gives it any pairs held while there were none
+//Take in the node listening socket
+//returns nothing
+void node_join(int node_sd)
+{
+	struct pair held[MAX_PENDING];
+	int held_count;
+	int sd;
+	int i;
+
+	if ((sd = accept(node_sd, NULL, NULL)) < 0) {
+		fprintf(stderr, "Error: Node accept failed\n");
+		return;
+	}
+	if (node_count == MAX_NODES)
+	{
+		fprintf(stderr, "Error: Too many nodes, turning one away\n");
+		close(sd);
+		return;
+	}
+	// Never wait on a node, one that stops reading would hold up every lobby
+	fcntl(sd, F_SETFL, O_NONBLOCK);
+	nodes[node_count].sd = sd;
+	nodes[node_count].id = next_node_id++;
+	nodes[node_count].live_games = 0;
+	node_count++;
+	printf("node %d joined, loads", nodes[node_count - 1].id);
+	log_loads(-1);
+
+	held_count = pending_count;
+	memcpy(held, pending, sizeof(struct pair) * held_count);
+	pending_count = 0;
+	for (i = 0; i < held_count; i++)
+	{
+		dispatch(&held[i]);
+	}
+}
+
+//Reads a load report from a node, dropping the node if it hung up
+//Changes are logged so a node draining shows up as well as one filling
+//Take in the node's index
+//returns nothing
+void node_message(int index)
+{
+	struct cluster_msg msg;
+	int fds[2];
+	int nfds;
+
+	nfds = recv_fds(nodes[index].sd, &msg, sizeof(msg), fds, 2);
+	if (nfds < 0)
+	{
+		node_leave(index);
+		return;
+	}
+	while (nfds > 0)
+	{
+		close(fds[--nfds]); //nodes have no business sending sockets
+	}
+	if (msg.kind == CLUSTER_LOAD && msg.live_games != nodes[index].live_games)
+	{
+		nodes[index].live_games = msg.live_games;
+		printf("node %d reported %d games, loads", nodes[index].id, msg.live_games);
+		log_loads(-1);
+	}
+}
+
+//Forgets a node, its running games carry on without the coordinator
+//Take in the node's index
+//returns nothing
+void node_leave(int index)
+{
+	int id = nodes[index].id;
+
+	close(nodes[index].sd);
+	nodes[index] = nodes[--node_count];
+	printf("node %d left, loads", id);
+	log_loads(-1);
+}
+
+//Finishes a log line with every node's live games, marking the chosen one
+//Take in the chosen node's index, -1 for none
+//returns nothing
+void log_loads(int chosen)
+{
+	int i;
+
+	for (i = 0; i < node_count; i++)
+	{
+		printf(" %d:%d%s", nodes[i].id, nodes[i].live_games, (i == chosen) ? "*" : "");
+	}
+	if (node_count == 0)
+	{
+		printf(" none");
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+//returns the command line name of a game type
+char * game_name(char game_type)
+{
+	if (game_type == 'S')
+	{
+		return "standard";
+	}
+	else if (game_type == 'P')
+	{
+		return "popout";
+	}
+	return "antistack";
+}
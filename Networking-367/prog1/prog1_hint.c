@@ -0,0 +1,583 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "prog1_rules.h"
+#include "prog1_hint.h"
+
+#define HINT_KEY_LEN 44 /* game type, player to move, 42 cell board */
+#define HINT_WIN 100 /* score for winning on the next move */
+#define HINT_WAIT_NS 100000000L /* how often a waiter checks the searcher is still alive */
+
+#define HINT_EMPTY 0
+#define HINT_PENDING 1 /* someone is searching this position */
+#define HINT_READY 2
+
+struct hint_entry {
+	char key[HINT_KEY_LEN];
+	unsigned long hash;
+	int state;
+	pid_t searcher; /* process searching a pending entry */
+	struct hint_result result;
+	int next; /* next entry in the bucket chain or free list */
+	int lru_prev; /* towards the most recently used end */
+	int lru_next;
+};
+
+struct hint_shard {
+	pthread_mutex_t lock;
+	pthread_cond_t ready; /* signalled when a pending search finishes, on CLOCK_MONOTONIC */
+	int buckets[HINT_BUCKETS];
+	struct hint_entry entries[HINT_SHARD_ENTRIES];
+	int lru_head; /* most recently used */
+	int lru_tail; /* next to be evicted */
+	int free_list;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long coalesced; /* waited on someone else's search */
+	unsigned long long miss_ns; /* total time spent searching */
+	unsigned long long miss_ns_max;
+};
+
+struct hint_cache {
+	struct hint_shard shards[HINT_SHARDS];
+};
+
+static const int hint_column_order[7] = { 3, 2, 4, 1, 5, 0, 6 };
+static const int hint_column_weight[7] = { 0, 1, 2, 3, 2, 1, 0 };
+
+//Empties a shard, keeping its counters
+//returns nothing
+static void hint_shard_reset(struct hint_shard * shard)
+{
+	int i;
+
+	for (i = 0; i < HINT_BUCKETS; i++)
+	{
+		shard->buckets[i] = -1;
+	}
+	for (i = 0; i < HINT_SHARD_ENTRIES; i++)
+	{
+		shard->entries[i].state = HINT_EMPTY;
+		shard->entries[i].next = i + 1;
+	}
+	shard->entries[HINT_SHARD_ENTRIES - 1].next = -1;
+	shard->free_list = 0;
+	shard->lru_head = -1;
+	shard->lru_tail = -1;
+}
+
+//Takes a shard's lock back from a process that died holding it
+//Its chains may be half updated so the shard starts over empty
+//returns nothing
+static void hint_recover(struct hint_shard * shard)
+{
+	pthread_mutex_consistent(&shard->lock);
+	hint_shard_reset(shard);
+	pthread_cond_broadcast(&shard->ready);
+}
+
+//Locks a shard, recovering it if the last holder died
+static void hint_lock(struct hint_shard * shard)
+{
+	if (pthread_mutex_lock(&shard->lock) == EOWNERDEAD)
+	{
+		hint_recover(shard);
+	}
+}
+
+//Waits a while for a pending search to finish, caller holds the shard lock
+//returns nothing, the caller checks what changed
+static void hint_wait(struct hint_shard * shard)
+{
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_nsec += HINT_WAIT_NS;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	if (pthread_cond_timedwait(&shard->ready, &shard->lock, &deadline) == EOWNERDEAD)
+	{
+		hint_recover(shard);
+	}
+}
+
+//Allocates the cache in shared memory so forked children all use it
+//Locks are robust so a child dying mid lookup can't wedge a shard
+//returns the cache, exits if it can't be allocated
+struct hint_cache * hint_cache_create(void)
+{
+	struct hint_cache * cache;
+	pthread_mutexattr_t mutex_attr;
+	pthread_condattr_t cond_attr;
+	int s;
+
+	cache = mmap(NULL, sizeof(*cache), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (cache == MAP_FAILED)
+	{
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	pthread_mutexattr_init(&mutex_attr);
+	pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	for (s = 0; s < HINT_SHARDS; s++)
+	{
+		struct hint_shard * shard = &cache->shards[s];
+		pthread_mutex_init(&shard->lock, &mutex_attr);
+		pthread_cond_init(&shard->ready, &cond_attr);
+		hint_shard_reset(shard);
+	}
+	pthread_mutexattr_destroy(&mutex_attr);
+	pthread_condattr_destroy(&cond_attr);
+	return cache;
+}
+
+//Builds the cache key, folding a board onto its mirror image
+//Antistack boards aren't folded, its win check doesn't treat a board and its mirror alike
+//Take in the position and a buffer for the key
+//returns 1 if the key holds the mirrored board, 0 otherwise
+static int hint_key(char game_type, int player_number, char * game_board, char * key)
+{
+	char mirror[42];
+	int row;
+	int col;
+
+	for (row = 0; row < 42; row += 7)
+	{
+		for (col = 0; col < 7; col++)
+		{
+			mirror[row + col] = game_board[row + 6 - col];
+		}
+	}
+	key[0] = game_type;
+	key[1] = (char)('0' + player_number);
+	if (game_type != 'K' && memcmp(mirror, game_board, 42) < 0)
+	{
+		memcpy(key + 2, mirror, 42);
+		return 1;
+	}
+	memcpy(key + 2, game_board, 42);
+	return 0;
+}
+
+//FNV-1a hash of a cache key
+static unsigned long hint_hash(char * key)
+{
+	unsigned long hash = 14695981039346656037UL;
+	int i;
+
+	for (i = 0; i < HINT_KEY_LEN; i++)
+	{
+		hash ^= (unsigned char)key[i];
+		hash *= 1099511628211UL;
+	}
+	return hash;
+}
+
+static unsigned long long hint_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//Scores a quiet position for the player who just moved by how central their tokens are
+static int hint_heuristic(char game_type, char * game_board, int player_number)
+{
+	char mine = (char)('0' + player_number);
+	int score = 0;
+	int i;
+
+	if (game_type == 'K')
+	{
+		return 0; //nothing useful to say about antistack short of a loss
+	}
+	for (i = 0; i < 42; i++)
+	{
+		if (game_board[i] == mine)
+		{
+			score += hint_column_weight[i % 7];
+		}
+		else if (game_board[i] != '0')
+		{
+			score -= hint_column_weight[i % 7];
+		}
+	}
+	if (score > HINT_WIN / 2)
+	{
+		score = HINT_WIN / 2;
+	}
+	else if (score < -HINT_WIN / 2)
+	{
+		score = -HINT_WIN / 2;
+	}
+	return score;
+}
+
+//Negamax with alpha-beta over every move apply_move accepts
+//Take in the position, plies left, ply from the root and the window
+//returns the score for player_number, best_move gets the move if it's not NULL
+static int hint_search(char game_type, char * game_board, int player_number, int depth, int ply, int alpha, int beta, char * best_move)
+{
+	char board[42];
+	char move[2];
+	int best = -HINT_WIN - 1;
+	int score;
+	int status;
+	int kind;
+	int i;
+
+	if (best_move != NULL)
+	{
+		best_move[0] = '-';
+		best_move[1] = '-';
+	}
+	for (kind = 0; kind < 2; kind++)
+	{
+		move[0] = (kind == 0) ? 'A' : 'P';
+		if (kind == 1 && game_type != 'P')
+		{
+			break;
+		}
+		for (i = 0; i < 7; i++)
+		{
+			move[1] = (char)('0' + hint_column_order[i]);
+			memcpy(board, game_board, 42);
+			if (apply_move(game_type, move, board, player_number) != 1)
+			{
+				continue;
+			}
+			status = check_winner(game_type, board, player_number);
+			if (status == 1)
+			{
+				score = (game_type == 'K') ? -(HINT_WIN - ply) : HINT_WIN - ply;
+			}
+			else if (status == 2)
+			{
+				score = 0;
+			}
+			else if (depth <= 1)
+			{
+				score = hint_heuristic(game_type, board, player_number);
+			}
+			else
+			{
+				score = -hint_search(game_type, board, 3 - player_number, depth - 1, ply + 1, -beta, -alpha, NULL);
+			}
+			if (score > best)
+			{
+				best = score;
+				if (best_move != NULL)
+				{
+					memcpy(best_move, move, 2);
+				}
+			}
+			if (best > alpha)
+			{
+				alpha = best;
+			}
+			if (alpha >= beta)
+			{
+				return best;
+			}
+		}
+	}
+	if (best < -HINT_WIN)
+	{
+		return 0; //no legal move
+	}
+	return best;
+}
+
+//Finds a key in a shard, caller holds the shard lock
+//returns the entry index or -1
+static int hint_find(struct hint_shard * shard, int bucket, unsigned long hash, char * key)
+{
+	int i;
+
+	for (i = shard->buckets[bucket]; i >= 0; i = shard->entries[i].next)
+	{
+		if (shard->entries[i].hash == hash && memcmp(shard->entries[i].key, key, HINT_KEY_LEN) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void hint_lru_unlink(struct hint_shard * shard, int i)
+{
+	struct hint_entry * entry = &shard->entries[i];
+
+	if (entry->lru_prev >= 0)
+	{
+		shard->entries[entry->lru_prev].lru_next = entry->lru_next;
+	}
+	else
+	{
+		shard->lru_head = entry->lru_next;
+	}
+	if (entry->lru_next >= 0)
+	{
+		shard->entries[entry->lru_next].lru_prev = entry->lru_prev;
+	}
+	else
+	{
+		shard->lru_tail = entry->lru_prev;
+	}
+}
+
+static void hint_lru_push(struct hint_shard * shard, int i)
+{
+	struct hint_entry * entry = &shard->entries[i];
+
+	entry->lru_prev = -1;
+	entry->lru_next = shard->lru_head;
+	if (shard->lru_head >= 0)
+	{
+		shard->entries[shard->lru_head].lru_prev = i;
+	}
+	else
+	{
+		shard->lru_tail = i;
+	}
+	shard->lru_head = i;
+}
+
+//Takes an entry out of its bucket chain and the LRU list, caller holds the shard lock
+//returns nothing, the entry is left empty for the caller to reuse or free
+static void hint_unlink(struct hint_shard * shard, int i)
+{
+	struct hint_entry * entry = &shard->entries[i];
+	int bucket;
+	int *link;
+
+	bucket = (entry->hash / HINT_SHARDS) % HINT_BUCKETS;
+	for (link = &shard->buckets[bucket]; *link != i; link = &shard->entries[*link].next)
+	{
+	}
+	*link = entry->next;
+	hint_lru_unlink(shard, i);
+	entry->state = HINT_EMPTY;
+}
+
+//Takes an entry off the free list, or evicts the least recently used finished one
+//Caller holds the shard lock
+//returns the entry index or -1 if every entry is mid-search
+static int hint_alloc(struct hint_shard * shard)
+{
+	int i;
+
+	if (shard->free_list >= 0)
+	{
+		i = shard->free_list;
+		shard->free_list = shard->entries[i].next;
+		return i;
+	}
+	for (i = shard->lru_tail; i >= 0; i = shard->entries[i].lru_prev)
+	{
+		if (shard->entries[i].state == HINT_READY)
+		{
+			break;
+		}
+	}
+	if (i < 0)
+	{
+		return -1;
+	}
+	hint_unlink(shard, i);
+	return i;
+}
+
+//Gets the best move for a position from the cache, searching it on a miss
+//Take in the position and where to put the answer
+//returns nothing
+void hint_lookup(struct hint_cache * cache, char game_type, int player_number, char * game_board, struct hint_result * result)
+{
+	char key[HINT_KEY_LEN];
+	struct hint_shard * shard;
+	struct hint_entry * entry;
+	unsigned long hash;
+	unsigned long long start;
+	unsigned long long elapsed;
+	int mirrored;
+	int bucket;
+	int waited = 0;
+	int i;
+
+	mirrored = hint_key(game_type, player_number, game_board, key);
+	hash = hint_hash(key);
+	shard = &cache->shards[hash % HINT_SHARDS];
+	bucket = (hash / HINT_SHARDS) % HINT_BUCKETS;
+
+	hint_lock(shard);
+	while ((i = hint_find(shard, bucket, hash, key)) >= 0 && shard->entries[i].state == HINT_PENDING)
+	{
+		if (kill(shard->entries[i].searcher, 0) < 0 && errno == ESRCH)
+		{
+			//Searcher died before answering, drop its claim and search it here
+			hint_unlink(shard, i);
+			shard->entries[i].next = shard->free_list;
+			shard->free_list = i;
+			continue;
+		}
+		if (!waited)
+		{
+			shard->coalesced++;
+			waited = 1;
+		}
+		hint_wait(shard);
+	}
+	if (i >= 0)
+	{
+		if (!waited)
+		{
+			shard->hits++;
+		}
+		hint_lru_unlink(shard, i);
+		hint_lru_push(shard, i);
+		*result = shard->entries[i].result;
+		pthread_mutex_unlock(&shard->lock);
+	}
+	else
+	{
+		//Miss, claim the position so anyone else asking waits for this search
+		shard->misses++;
+		i = hint_alloc(shard);
+		if (i >= 0)
+		{
+			entry = &shard->entries[i];
+			memcpy(entry->key, key, HINT_KEY_LEN);
+			entry->hash = hash;
+			entry->state = HINT_PENDING;
+			entry->searcher = getpid();
+			entry->next = shard->buckets[bucket];
+			shard->buckets[bucket] = i;
+			hint_lru_push(shard, i);
+		}
+		pthread_mutex_unlock(&shard->lock);
+
+		start = hint_now_ns();
+		result->eval = (signed char)hint_search(game_type, key + 2, player_number, HINT_DEPTH, 1, -HINT_WIN - 1, HINT_WIN + 1, result->move);
+		elapsed = hint_now_ns() - start;
+
+		hint_lock(shard);
+		shard->miss_ns += elapsed;
+		if (elapsed > shard->miss_ns_max)
+		{
+			shard->miss_ns_max = elapsed;
+		}
+		//The claim is gone if the shard was recovered while we searched
+		if (i >= 0 && shard->entries[i].state == HINT_PENDING && shard->entries[i].searcher == getpid())
+		{
+			shard->entries[i].result = *result;
+			shard->entries[i].state = HINT_READY;
+			pthread_cond_broadcast(&shard->ready);
+		}
+		pthread_mutex_unlock(&shard->lock);
+	}
+
+	//Answer is for the canonical board, flip it back if we mirrored
+	if (mirrored && result->move[0] != '-')
+	{
+		result->move[1] = (char)('0' + 6 - (result->move[1] - '0'));
+	}
+}
+
+//Writes the cache counters as one line of text
+//Take in the cache and a buffer
+//returns the length written
+int hint_stats(struct hint_cache * cache, char * buf, int len)
+{
+	unsigned long hits = 0;
+	unsigned long misses = 0;
+	unsigned long coalesced = 0;
+	unsigned long long miss_ns = 0;
+	unsigned long long miss_ns_max = 0;
+	unsigned long total;
+	int s;
+
+	for (s = 0; s < HINT_SHARDS; s++)
+	{
+		struct hint_shard * shard = &cache->shards[s];
+		hint_lock(shard);
+		hits += shard->hits;
+		misses += shard->misses;
+		coalesced += shard->coalesced;
+		miss_ns += shard->miss_ns;
+		if (shard->miss_ns_max > miss_ns_max)
+		{
+			miss_ns_max = shard->miss_ns_max;
+		}
+		pthread_mutex_unlock(&shard->lock);
+	}
+	total = hits + misses + coalesced;
+	return snprintf(buf, len, "hits=%lu misses=%lu coalesced=%lu hit_rate=%.3f miss_avg_us=%.1f miss_max_us=%.1f\n",
+		hits, misses, coalesced,
+		total ? (double)(hits + coalesced) / total : 0.0,
+		misses ? miss_ns / 1000.0 / misses : 0.0,
+		miss_ns_max / 1000.0);
+}
+
+//Answers hint port requests on a connection until it closes
+//Take in the connection and the cache
+//returns nothing
+void hint_serve(int sd, struct hint_cache * cache)
+{
+	struct hint_result result;
+	char request[HINT_KEY_LEN];
+	char reply[128];
+	char invalid = 'I';
+	char type;
+	int len;
+	int i;
+
+	while (recv(sd, &type, 1, 0) == 1)
+	{
+		if (type == 'S')
+		{
+			len = hint_stats(cache, reply, sizeof(reply));
+			send(sd, reply, len, 0);
+			continue;
+		}
+		if (type != 'E')
+		{
+			send(sd, &invalid, 1, 0);
+			continue;
+		}
+		if (recv(sd, request, HINT_KEY_LEN, MSG_WAITALL) != HINT_KEY_LEN)
+		{
+			return;
+		}
+		for (i = 2; i < HINT_KEY_LEN && request[i] >= '0' && request[i] <= '2'; i++)
+		{
+		}
+		if ((request[0] != 'S' && request[0] != 'P' && request[0] != 'K') ||
+			(request[1] != '1' && request[1] != '2') || i < HINT_KEY_LEN)
+		{
+			send(sd, &invalid, 1, 0);
+			continue;
+		}
+		hint_lookup(cache, request[0], request[1] - '0', request + 2, &result);
+		reply[0] = 'E';
+		reply[1] = result.move[0];
+		reply[2] = result.move[1];
+		reply[3] = result.eval;
+		send(sd, reply, 4, 0);
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef PROG1_HINT_H
+#define PROG1_HINT_H
+
+/*------------------------------------------------------------------------
+* Hint service: best move and evaluation for a position, searched with
+* the rules in prog1_rules.c.
+*
+* Results live in an LRU cache split into HINT_SHARDS independently
+* locked shards. The cache is allocated in shared memory before the
+* server forks so every game child and hint connection shares it. A
+* position and its mirror image share one entry (except in antistack),
+* and callers asking for a position that is already being searched wait
+* for that search instead of starting their own. A waiter whose searcher
+* died takes the search over, and a shard whose lock holder died is
+* emptied.
+*
+* Hint port protocol, any number of requests per connection:
+*   'E' type player board[42] -> 'E' move[2] eval   (move "--" if none)
+*   'S'                       -> one line of cache stats ending in '\n'
+*   anything else             -> 'I'
+* eval is a signed byte from the mover's side, +100 is a win right away.
+*------------------------------------------------------------------------
+*/
+
+#define HINT_SHARDS 16 /* independently locked cache shards */
+#define HINT_SHARD_ENTRIES 1024 /* cached positions per shard */
+#define HINT_BUCKETS 2048 /* hash buckets per shard */
+#define HINT_DEPTH 8 /* plies searched per hint */
+
+struct hint_cache;
+
+struct hint_result {
+	char move[2]; /* best move, 'A' or 'P' followed by a column */
+	signed char eval; /* -100 to 100 from the mover's side */
+};
+
+struct hint_cache * hint_cache_create(void);
+void hint_lookup(struct hint_cache * cache, char game_type, int player_number, char * game_board, struct hint_result * result);
+int hint_stats(struct hint_cache * cache, char * buf, int len);
+void hint_serve(int sd, struct hint_cache * cache);
+
+#endif
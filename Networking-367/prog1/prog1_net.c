@@ -0,0 +1,195 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include "prog1_net.h"
+
+//Creates a TCP socket listening on every local address
+//Take in the port number as typed on the command line
+//returns the listening socket, exits on failure
+int open_listener(char * port_arg)
+{
+	struct protoent *ptrp; /* pointer to a protocol table entry */
+	struct sockaddr_in sad; /* structure to hold server's address */
+	int sd; /* socket descriptor */
+	int port; /* protocol port number */
+
+	memset((char *)&sad,0,sizeof(sad)); /* clear sockaddr structure */
+	sad.sin_family = AF_INET; /* set family to Internet */
+	sad.sin_addr.s_addr = INADDR_ANY; /* set the local IP address */
+
+	port = atoi(port_arg); /* convert argument to binary */
+	if (port > 0) { /* test for illegal value */
+		sad.sin_port = htons((u_short)port);
+	} else { /* print error message and exit */
+		fprintf(stderr,"Error: Bad port number %s\n",port_arg);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Map TCP transport protocol name to protocol number */
+	if ( ((long int)(ptrp = getprotobyname("tcp"))) == 0) {
+		fprintf(stderr, "Error: Cannot map \"tcp\" to protocol number");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Create a socket */
+	sd = socket(PF_INET, SOCK_STREAM, ptrp->p_proto);
+	if (sd < 0) {
+		fprintf(stderr, "Error: Socket creation failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Bind a local address to the socket */
+	if (bind(sd, (struct sockaddr *)&sad, sizeof(sad)) < 0) {
+		fprintf(stderr,"Error: Bind failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Specify size of request queue */
+	if (listen(sd, QLEN) < 0) {
+		fprintf(stderr,"Error: Listen failed\n");
+		exit(EXIT_FAILURE);
+	}
+	return sd;
+}
+
+//Looks up a server's address
+//Take in the host name and port number as typed on the command line, and where to put the address
+//returns nothing, exits on failure
+void resolve_server(char * host, char * port_arg, struct sockaddr_in * sad)
+{
+	struct hostent *ptrh; 	/* pointer to a host table entry */
+	int port; 				/* protocol port number */
+
+	memset((char *)sad,0,sizeof(*sad)); /* clear sockaddr structure */
+	sad->sin_family = AF_INET; /* set family to Internet */
+
+	port = atoi(port_arg); /* convert to binary */
+	if (port > 0) /* test for legal value */
+	sad->sin_port = htons((u_short)port);
+	else {
+		fprintf(stderr,"Error: bad port number %s\n",port_arg);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Convert host name to equivalent IP address and copy to sad. */
+	ptrh = gethostbyname(host);
+	if ( ptrh == NULL ) {
+		fprintf(stderr,"Error: Invalid host: %s\n", host);
+		exit(EXIT_FAILURE);
+	}
+
+	memcpy(&sad->sin_addr, ptrh->h_addr, ptrh->h_length);
+}
+
+//Opens a TCP connection to a server
+//Take in the server's address from resolve_server
+//returns the connected socket, -1 on failure
+int connect_server(struct sockaddr_in * sad)
+{
+	int sd; 					/* socket descriptor */
+
+	/* Create a socket. */
+	sd = socket(PF_INET, SOCK_STREAM, 0);
+	if (sd < 0) {
+		fprintf(stderr, "Error: Socket creation failed\n");
+		return -1;
+	}
+
+	/* Connect the socket to the specified server. */
+	if (connect(sd, (struct sockaddr *)sad, sizeof(*sad)) < 0) {
+		fprintf(stderr,"connect failed\n");
+		close(sd);
+		return -1;
+	}
+	return sd;
+}
+
+//Sends a message over a Unix socket, passing any sockets along with it
+//Take in the Unix socket, the message and its length and the sockets to pass
+//returns 1 on success, -1 on failure
+int send_fds(int sd, void * msg, int len, int * fds, int nfds)
+{
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char control[CMSG_SPACE(sizeof(int) * PASS_MAX_FDS)];
+
+	memset(&mh, 0, sizeof(mh));
+	iov.iov_base = msg;
+	iov.iov_len = len;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	if (nfds > 0)
+	{
+		memset(control, 0, sizeof(control));
+		mh.msg_control = control;
+		mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+		cmsg = CMSG_FIRSTHDR(&mh);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+	}
+	while (sendmsg(sd, &mh, MSG_NOSIGNAL) < 0)
+	{
+		if (errno != EINTR)
+		{
+			return -1;
+		}
+	}
+	return 1;
+}
+
+//Receives a whole message and any sockets passed with it
+//Take in the Unix socket, where to put the message and its length and room for max_fds sockets
+//returns the number of sockets received, -1 on error or when the peer hung up
+int recv_fds(int sd, void * msg, int len, int * fds, int max_fds)
+{
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char control[CMSG_SPACE(sizeof(int) * PASS_MAX_FDS)];
+	int passed[PASS_MAX_FDS];
+	int n;
+	int i;
+	int nfds = 0;
+
+	memset(&mh, 0, sizeof(mh));
+	iov.iov_base = msg;
+	iov.iov_len = len;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = control;
+	mh.msg_controllen = sizeof(control);
+	while ((n = recvmsg(sd, &mh, 0)) < 0 && errno == EINTR)
+	{
+	}
+	if (n != len)
+	{
+		return -1;
+	}
+	for (cmsg = CMSG_FIRSTHDR(&mh); cmsg != NULL; cmsg = CMSG_NXTHDR(&mh, cmsg))
+	{
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+		{
+			nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(passed, CMSG_DATA(cmsg), sizeof(int) * nfds);
+			for (i = max_fds; i < nfds; i++)
+			{
+				close(passed[i]); //more than the caller wanted
+			}
+			if (nfds > max_fds)
+			{
+				nfds = max_fds;
+			}
+			memcpy(fds, passed, sizeof(int) * nfds);
+		}
+	}
+	return nfds;
+}
@@ -0,0 +1,15 @@
+#ifndef PROG1_NET_H
+#define PROG1_NET_H
+
+#define QLEN 6 /* size of request queue */
+#define PASS_MAX_FDS 4 /* most sockets passed in one message */
+
+struct sockaddr_in;
+
+int open_listener(char * port_arg);
+void resolve_server(char * host, char * port_arg, struct sockaddr_in * sad);
+int connect_server(struct sockaddr_in * sad);
+int send_fds(int sd, void * msg, int len, int * fds, int nfds);
+int recv_fds(int sd, void * msg, int len, int * fds, int max_fds);
+
+#endif
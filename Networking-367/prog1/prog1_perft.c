@@ -0,0 +1,572 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "prog1_rules.h"
+
+#define PERFT_MAX_DEPTH 42 /* a game can't run longer than the board */
+#define PERFT_MAX_THREADS 64
+#define PERFT_SPLIT 3 /* plies expanded up front to make work for the threads */
+#define PERFT_WAYS 2 /* table entries per bucket, one kept by depth and one always replaced */
+#define PERFT_LOCKS 4096 /* lock stripes over the table buckets */
+
+/*------------------------------------------------------------------------
+* Program: perft
+*
+* Purpose: count every line of play to a given depth, for checking and
+* timing the rules in prog1_rules.c
+* (1) expand the first few plies and merge transpositions into tasks
+* (2) threads take tasks and walk each subtree, sharing a table of
+*     subtree counts keyed by position and depth left
+* (3) report the counts for every depth up to the one asked for, with
+*     nodes per second, and check them against the reference table
+*
+* Moves come from apply_move and games end where check_winner says, so
+* the counts are exactly what the server would allow. For depth N:
+*   leaves - positions reached after exactly N plies, over every order
+*            of moves that gets there
+*   wins   - games won by each player within N plies (in antistack the
+*            player who lined up loses)
+*   ties   - games tied within N plies
+*   nodes  - positions this run actually generated, the table and the
+*            merged tasks make this smaller than the sum of the leaves
+*
+* The reference table was made by the naive pass, 1 thread and no table,
+* so any faster move generator or win checker can be checked against
+* it. Exits with failure if any count is off.
+*
+* Syntax: perft [ game type ] [ depth ] [ threads ] [ table MB ]
+*
+* game type - standard, popout or antistack
+* threads - defaults to one per core
+* table MB - size of the transposition table, defaults to 256, 0 for none
+*
+*------------------------------------------------------------------------
+*/
+
+struct perft_counts {
+	unsigned long long leaves;
+	unsigned long long wins[2]; /* player one, player two */
+	unsigned long long ties;
+};
+
+struct perft_entry {
+	unsigned long long key[2]; /* see perft_key */
+	int depth; /* plies the counts cover, 0 for an empty slot */
+	struct perft_counts counts;
+};
+
+struct perft_task {
+	unsigned long long key[2];
+	char board[42];
+	int player; /* player to move */
+	unsigned long long paths; /* move orders that reach this position */
+};
+
+struct perft_worker {
+	pthread_t tid;
+	unsigned long long nodes;
+	unsigned long long hits; /* subtrees taken from the table */
+	struct perft_counts counts;
+};
+
+struct perft_reference {
+	char game_type;
+	int depth;
+	struct perft_counts counts;
+};
+
+//Counts from the naive pass (./perft game_type 11 1 0)
+//The standard leaves match the published Connect 4 game counts
+static const struct perft_reference perft_reference[] = {
+	{ 'S',  1, { 7ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'S',  2, { 49ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'S',  3, { 343ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'S',  4, { 2401ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'S',  5, { 16807ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'S',  6, { 117649ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'S',  7, { 823536ULL, { 13032ULL, 0ULL }, 0ULL } },
+	{ 'S',  8, { 5673234ULL, { 13032ULL, 44430ULL }, 0ULL } },
+	{ 'S',  9, { 39394572ULL, { 1099914ULL, 44430ULL }, 0ULL } },
+	{ 'S', 10, { 268031646ULL, { 1099914ULL, 4305488ULL }, 0ULL } },
+	{ 'S', 11, { 1844590828ULL, { 68382666ULL, 4305488ULL }, 0ULL } },
+	{ 'P',  1, { 7ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'P',  2, { 49ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'P',  3, { 392ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'P',  4, { 3087ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'P',  5, { 26320ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'P',  6, { 220626ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'P',  7, { 1965614ULL, { 21714ULL, 0ULL }, 0ULL } },
+	{ 'P',  8, { 17029874ULL, { 21714ULL, 135294ULL }, 0ULL } },
+	{ 'P',  9, { 155057170ULL, { 2626578ULL, 135294ULL }, 0ULL } },
+	{ 'P', 10, { 1378203750ULL, { 2626578ULL, 19200494ULL }, 0ULL } },
+	{ 'P', 11, { 12746442841ULL, { 289062954ULL, 19200494ULL }, 0ULL } },
+	{ 'K',  1, { 7ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'K',  2, { 49ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'K',  3, { 343ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'K',  4, { 2401ULL, { 0ULL, 0ULL }, 0ULL } },
+	{ 'K',  5, { 16807ULL, { 0ULL, 1152ULL }, 0ULL } },
+	{ 'K',  6, { 109585ULL, { 4872ULL, 1152ULL }, 0ULL } },
+	{ 'K',  7, { 732984ULL, { 4872ULL, 85639ULL }, 0ULL } },
+	{ 'K',  8, { 4539185ULL, { 394784ULL, 85639ULL }, 0ULL } },
+	{ 'K',  9, { 29038893ULL, { 394784ULL, 4717059ULL }, 0ULL } },
+	{ 'K', 10, { 170756167ULL, { 23071725ULL, 4717059ULL }, 0ULL } },
+	{ 'K', 11, { 1035293026ULL, { 23071725ULL, 218287281ULL }, 0ULL } }
+};
+
+static const char perft_moves[14][2] = {
+	{ 'A', '0' }, { 'A', '1' }, { 'A', '2' }, { 'A', '3' }, { 'A', '4' }, { 'A', '5' }, { 'A', '6' },
+	{ 'P', '0' }, { 'P', '1' }, { 'P', '2' }, { 'P', '3' }, { 'P', '4' }, { 'P', '5' }, { 'P', '6' }
+};
+
+char game_type;
+int move_count; /* 14 in popout, 7 otherwise */
+struct perft_entry * table; /* NULL when running without one */
+unsigned long table_buckets;
+pthread_mutex_t table_locks[PERFT_LOCKS];
+struct perft_task * tasks;
+int task_count;
+int task_space;
+int next_task; /* next task for a thread to take */
+int task_depth; /* plies left to walk below each task */
+
+//Prototypes
+void perft_key(char * game_board, int player, unsigned long long * key);
+int perft_probe(unsigned long long * key, int depth, struct perft_counts * counts);
+void perft_store(unsigned long long * key, int depth, struct perft_counts * counts);
+void perft(struct perft_worker * worker, char * game_board, int player, int depth, struct perft_counts * counts);
+void perft_split(struct perft_worker * worker, char * game_board, int player, int plies, unsigned long long paths, struct perft_counts * counts);
+void add_task(char * game_board, int player, unsigned long long paths);
+void merge_tasks(void);
+void * perft_thread(void * arg);
+void add_counts(struct perft_counts * total, struct perft_counts * counts, unsigned long long times);
+const struct perft_reference * find_reference(int depth);
+
+int main(int argc, char **argv)
+{
+	struct perft_worker workers[PERFT_MAX_THREADS];
+	struct perft_worker split; /* counts for the plies expanded before the threads start */
+	struct perft_counts total;
+	const struct perft_reference * ref;
+	struct timespec start;
+	struct timespec end;
+	char game_board[42];
+	unsigned long long nodes;
+	unsigned long long hits;
+	long table_mb = 256;
+	double seconds;
+	int nthreads;
+	int max_depth;
+	int depth;
+	int failed = 0;
+	int i;
+
+	if (argc < 3 || argc > 5) {
+		fprintf(stderr,"Error: Wrong number of arguments\n");
+		fprintf(stderr,"usage:\n");
+		fprintf(stderr,"./perft game_type depth [threads] [table_mb]\n");
+		exit(EXIT_FAILURE);
+	}
+	if (strcmp(argv[1], "standard") == 0)
+	{
+		game_type = 'S';
+	}
+	else if (strcmp(argv[1], "popout") == 0)
+	{
+		game_type = 'P';
+	}
+	else if (strcmp(argv[1], "antistack") == 0)
+	{
+		game_type = 'K';
+	}
+	else
+	{
+		fprintf(stderr,"Error: Game type must be standard, popout or antistack\n");
+		exit(EXIT_FAILURE);
+	}
+	move_count = (game_type == 'P') ? 14 : 7;
+	max_depth = atoi(argv[2]);
+	if (max_depth < 1 || max_depth > PERFT_MAX_DEPTH) {
+		fprintf(stderr,"Error: Depth must be 1 to %d\n", PERFT_MAX_DEPTH);
+		exit(EXIT_FAILURE);
+	}
+	nthreads = (argc > 3) ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads < 1 || nthreads > PERFT_MAX_THREADS) {
+		fprintf(stderr,"Error: Threads must be 1 to %d\n", PERFT_MAX_THREADS);
+		exit(EXIT_FAILURE);
+	}
+	if (argc > 4)
+	{
+		table_mb = atol(argv[4]);
+	}
+
+	if (table_mb > 0)
+	{
+		table_buckets = (unsigned long)table_mb * 1024 * 1024 / (sizeof(struct perft_entry) * PERFT_WAYS);
+		table = calloc(table_buckets * PERFT_WAYS, sizeof(struct perft_entry));
+		if (table == NULL) {
+			fprintf(stderr,"Error: Cannot allocate a %ld MB table\n", table_mb);
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < PERFT_LOCKS; i++)
+		{
+			pthread_mutex_init(&table_locks[i], NULL);
+		}
+	}
+
+	printf("perft %s, %d threads, %ld MB table\n", argv[1], nthreads, (table != NULL) ? table_mb : 0L);
+	printf("%5s %16s %14s %14s %12s %14s %12s %9s %9s  %s\n",
+		"depth", "leaves", "p1 wins", "p2 wins", "ties", "nodes", "table hits", "secs", "Mnodes/s", "reference");
+
+	// Each depth is its own run, the table carries over since it is keyed by depth left
+	for (depth = 1; depth <= max_depth; depth++)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		memset(&total, 0, sizeof(total));
+		memset(&split, 0, sizeof(split));
+		memset(workers, 0, sizeof(workers));
+		memset(game_board, '0', sizeof(game_board));
+		task_count = 0;
+		next_task = 0;
+
+		// Deep enough runs get split into tasks, shallow ones are one task
+		if (depth > PERFT_SPLIT)
+		{
+			perft_split(&split, game_board, 1, PERFT_SPLIT, 1, &total);
+			task_depth = depth - PERFT_SPLIT;
+		}
+		else
+		{
+			add_task(game_board, 1, 1);
+			task_depth = depth;
+		}
+		merge_tasks();
+
+		for (i = 0; i < nthreads; i++)
+		{
+			pthread_create(&workers[i].tid, NULL, perft_thread, &workers[i]);
+		}
+		nodes = split.nodes;
+		hits = 0;
+		for (i = 0; i < nthreads; i++)
+		{
+			pthread_join(workers[i].tid, NULL);
+			add_counts(&total, &workers[i].counts, 1);
+			nodes += workers[i].nodes;
+			hits += workers[i].hits;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+		printf("%5d %16llu %14llu %14llu %12llu %14llu %12llu %9.3f %9.2f  ",
+			depth, total.leaves, total.wins[0], total.wins[1], total.ties, nodes, hits, seconds,
+			(seconds > 0) ? nodes / seconds / 1e6 : 0.0);
+		ref = find_reference(depth);
+		if (ref == NULL)
+		{
+			printf("-\n");
+		}
+		else if (memcmp(&ref->counts, &total, sizeof(total)) == 0)
+		{
+			printf("ok\n");
+		}
+		else
+		{
+			printf("MISMATCH, expected %llu %llu %llu %llu\n",
+				ref->counts.leaves, ref->counts.wins[0], ref->counts.wins[1], ref->counts.ties);
+			failed = 1;
+		}
+		fflush(stdout);
+	}
+	free(tasks);
+	free(table);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//Packs a position into a table key: player one's cells, player two's cells and who is to move
+//Popout takes tokens away, so the side to move can't be worked out from the board
+//Take in the game board, the player to move and where to put the two word key
+//returns nothing
+void perft_key(char * game_board, int player, unsigned long long * key)
+{
+	int i;
+
+	key[0] = (unsigned long long)(player - 1) << 63;
+	key[1] = 0;
+	for (i = 0; i < 42; i++)
+	{
+		if (game_board[i] == '1')
+		{
+			key[0] |= 1ULL << i;
+		}
+		else if (game_board[i] == '2')
+		{
+			key[1] |= 1ULL << i;
+		}
+	}
+}
+
+//Hashes a key down to a table bucket
+static unsigned long perft_bucket(unsigned long long * key)
+{
+	unsigned long long h = key[0] ^ (key[1] * 0x9e3779b97f4a7c15ULL);
+
+	h ^= h >> 31;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 29;
+	return (unsigned long)(h % table_buckets);
+}
+
+//Looks up a subtree's counts
+//Take in the position's key, the plies left and where to copy the counts
+//returns 1 on a hit, 0 otherwise
+int perft_probe(unsigned long long * key, int depth, struct perft_counts * counts)
+{
+	struct perft_entry * entry;
+	unsigned long bucket = perft_bucket(key);
+	int found = 0;
+	int i;
+
+	pthread_mutex_lock(&table_locks[bucket % PERFT_LOCKS]);
+	for (i = 0; i < PERFT_WAYS; i++)
+	{
+		entry = &table[bucket * PERFT_WAYS + i];
+		if (entry->depth == depth && entry->key[0] == key[0] && entry->key[1] == key[1])
+		{
+			*counts = entry->counts;
+			found = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&table_locks[bucket % PERFT_LOCKS]);
+	return found;
+}
+
+//Saves a subtree's counts
+//The first way keeps the deepest subtree seen, which saves the most work, the second takes whatever comes
+//Take in the position's key, the plies left and the counts
+//returns nothing
+void perft_store(unsigned long long * key, int depth, struct perft_counts * counts)
+{
+	struct perft_entry * entry;
+	unsigned long bucket = perft_bucket(key);
+
+	pthread_mutex_lock(&table_locks[bucket % PERFT_LOCKS]);
+	entry = &table[bucket * PERFT_WAYS];
+	if (entry->depth > depth)
+	{
+		entry++;
+	}
+	entry->key[0] = key[0];
+	entry->key[1] = key[1];
+	entry->depth = depth;
+	entry->counts = *counts;
+	pthread_mutex_unlock(&table_locks[bucket % PERFT_LOCKS]);
+}
+
+//Counts the subtree below a position
+//Take in the worker, the game board, the player to move, the plies left and the counts to add to
+//returns nothing
+void perft(struct perft_worker * worker, char * game_board, int player, int depth, struct perft_counts * counts)
+{
+	struct perft_counts sub;
+	unsigned long long key[2];
+	char child[42];
+	int status;
+	int i;
+
+	// Subtrees of one ply are cheaper to walk than to look up
+	if (table != NULL && depth > 1)
+	{
+		perft_key(game_board, player, key);
+		if (perft_probe(key, depth, &sub))
+		{
+			worker->hits++;
+			add_counts(counts, &sub, 1);
+			return;
+		}
+	}
+
+	memset(&sub, 0, sizeof(sub));
+	for (i = 0; i < move_count; i++)
+	{
+		memcpy(child, game_board, 42);
+		if (apply_move(game_type, (char *)perft_moves[i], child, player) != 1)
+		{
+			continue;
+		}
+		worker->nodes++;
+		if (depth == 1)
+		{
+			sub.leaves++;
+		}
+		status = check_winner(game_type, child, player);
+		if (status == 1)
+		{
+			sub.wins[(game_type == 'K') ? 2 - player : player - 1]++;
+		}
+		else if (status == 2)
+		{
+			sub.ties++;
+		}
+		else if (depth > 1)
+		{
+			perft(worker, child, 3 - player, depth - 1, &sub);
+		}
+	}
+
+	if (table != NULL && depth > 1)
+	{
+		perft_store(key, depth, &sub);
+	}
+	add_counts(counts, &sub, 1);
+}
+
+//Plays out the first plies, turning the positions they reach into tasks
+//Games that end this early are counted here
+//Take in the worker to count nodes on, the game board, the player to move, the plies still to expand,
+//how many move orders reach this position and the counts to add to
+//returns nothing
+void perft_split(struct perft_worker * worker, char * game_board, int player, int plies, unsigned long long paths, struct perft_counts * counts)
+{
+	char child[42];
+	int status;
+	int i;
+
+	if (plies == 0)
+	{
+		add_task(game_board, player, paths);
+		return;
+	}
+	for (i = 0; i < move_count; i++)
+	{
+		memcpy(child, game_board, 42);
+		if (apply_move(game_type, (char *)perft_moves[i], child, player) != 1)
+		{
+			continue;
+		}
+		worker->nodes++;
+		status = check_winner(game_type, child, player);
+		if (status == 1)
+		{
+			counts->wins[(game_type == 'K') ? 2 - player : player - 1] += paths;
+		}
+		else if (status == 2)
+		{
+			counts->ties += paths;
+		}
+		else
+		{
+			perft_split(worker, child, 3 - player, plies - 1, paths, counts);
+		}
+	}
+}
+
+//Adds a position to the task list
+//Take in the game board, the player to move and how many move orders reach it
+//returns nothing, exits if out of memory
+void add_task(char * game_board, int player, unsigned long long paths)
+{
+	struct perft_task * task;
+
+	if (task_count == task_space)
+	{
+		task_space = (task_space == 0) ? 1024 : task_space * 2;
+		tasks = realloc(tasks, task_space * sizeof(struct perft_task));
+		if (tasks == NULL) {
+			fprintf(stderr,"Error: Out of memory for tasks\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	task = &tasks[task_count++];
+	memcpy(task->board, game_board, 42);
+	task->player = player;
+	task->paths = paths;
+	perft_key(game_board, player, task->key);
+}
+
+//Orders tasks by key
+static int task_compare(const void * a, const void * b)
+{
+	const struct perft_task * x = a;
+	const struct perft_task * y = b;
+
+	if (x->key[0] != y->key[0])
+	{
+		return (x->key[0] < y->key[0]) ? -1 : 1;
+	}
+	if (x->key[1] != y->key[1])
+	{
+		return (x->key[1] < y->key[1]) ? -1 : 1;
+	}
+	return 0;
+}
+
+//Folds tasks for the same position into one, so each transposition is only walked once
+//returns nothing
+void merge_tasks(void)
+{
+	int kept = 0;
+	int i;
+
+	qsort(tasks, task_count, sizeof(struct perft_task), task_compare);
+	for (i = 0; i < task_count; i++)
+	{
+		if (kept > 0 && task_compare(&tasks[kept - 1], &tasks[i]) == 0)
+		{
+			tasks[kept - 1].paths += tasks[i].paths;
+		}
+		else
+		{
+			tasks[kept++] = tasks[i];
+		}
+	}
+	task_count = kept;
+}
+
+//Worker thread, walks tasks until there are none left
+//Take in the thread's perft_worker
+//returns NULL
+void * perft_thread(void * arg)
+{
+	struct perft_worker * worker = arg;
+	struct perft_counts counts;
+	int i;
+
+	while ((i = __sync_fetch_and_add(&next_task, 1)) < task_count)
+	{
+		memset(&counts, 0, sizeof(counts));
+		perft(worker, tasks[i].board, tasks[i].player, task_depth, &counts);
+		add_counts(&worker->counts, &counts, tasks[i].paths);
+	}
+	return NULL;
+}
+
+//Adds counts into a total
+//Take in the total, the counts and how many times they happen
+//returns nothing
+void add_counts(struct perft_counts * total, struct perft_counts * counts, unsigned long long times)
+{
+	total->leaves += counts->leaves * times;
+	total->wins[0] += counts->wins[0] * times;
+	total->wins[1] += counts->wins[1] * times;
+	total->ties += counts->ties * times;
+}
+
+//Finds the reference counts for this game type at a depth
+//returns the entry, NULL if the table doesn't go that deep
+const struct perft_reference * find_reference(int depth)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(perft_reference) / sizeof(perft_reference[0])); i++)
+	{
+		if (perft_reference[i].game_type == game_type && perft_reference[i].depth == depth)
+		{
+			return &perft_reference[i];
+		}
+	}
+	return NULL;
+}
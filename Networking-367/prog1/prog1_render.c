@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include "prog1_render.h"
+
+#define BOARD_TOP 3 /* screen row of the top of the board */
+#define TEXT_TOP (BOARD_TOP + 9) /* first row of the message area */
+#define TEXT_LINES 10 /* rows the message area holds, keeps it on a 24 row terminal */
+
+//Appends raw bytes to the frame, flushing first if they wouldn't fit
+static void render_append(struct render * r, const char * data, int len)
+{
+	if (r->len + len > RENDER_FRAME_MAX)
+	{
+		render_flush(r);
+		if (len > RENDER_FRAME_MAX)
+		{
+			len = RENDER_FRAME_MAX;
+		}
+	}
+	memcpy(r->frame + r->len, data, len);
+	r->len += len;
+}
+
+//Sets up a renderer
+//Take in the renderer and the fd to draw on, -1 to draw nothing
+//returns nothing
+void render_init(struct render * r, int fd)
+{
+	memset(r, 0, sizeof(*r));
+	r->fd = fd;
+	r->ansi = (fd >= 0 && isatty(fd));
+}
+
+//Sets the line shown above the board
+//Take in the renderer and the title
+//returns nothing
+void render_title(struct render * r, const char * title)
+{
+	strncpy(r->title, title, sizeof(r->title) - 1);
+	render_text(r, "%s\n", title);
+}
+
+//Adds a board to the frame, only the changed cells once one is on a terminal
+//Take in the renderer and game board
+//returns nothing
+void render_board(struct render * r, char * game_board)
+{
+	char line[64];
+	int len;
+	int i;
+
+	if (r->fd < 0)
+	{
+		return;
+	}
+	if (!r->ansi)
+	{
+		for (i = 0; i < 42; i++)
+		{
+			len = snprintf(line, sizeof(line), "%s %c ", (i % 7 == 0 && i != 0) ? "\n" : "", game_board[i]);
+			render_append(r, line, len);
+		}
+		render_text(r, "\n---------------------\n 0  1  2  3  4  5  6\n");
+		return;
+	}
+
+	if (!r->drawn)
+	{
+		len = snprintf(line, sizeof(line), "\033[H\033[2J%s", r->title);
+		render_append(r, line, len);
+		for (i = 0; i < 42; i++)
+		{
+			if (i % 7 == 0)
+			{
+				len = snprintf(line, sizeof(line), "\033[%d;1H", BOARD_TOP + i / 7);
+				render_append(r, line, len);
+			}
+			len = snprintf(line, sizeof(line), " %c ", game_board[i]);
+			render_append(r, line, len);
+		}
+		len = snprintf(line, sizeof(line), "\033[%d;1H---------------------\n 0  1  2  3  4  5  6", BOARD_TOP + 6);
+		render_append(r, line, len);
+		r->drawn = 1;
+	}
+	else
+	{
+		for (i = 0; i < 42; i++)
+		{
+			if (game_board[i] != r->shown[i])
+			{
+				len = snprintf(line, sizeof(line), "\033[%d;%dH%c", BOARD_TOP + i / 7, 2 + (i % 7) * 3, game_board[i]);
+				render_append(r, line, len);
+			}
+		}
+	}
+	memcpy(r->shown, game_board, 42);
+
+	//fresh message area under the board
+	len = snprintf(line, sizeof(line), "\033[%d;1H\033[J", TEXT_TOP);
+	render_append(r, line, len);
+	r->text_lines = 0;
+}
+
+//Adds a message to the frame
+//Under a board the message area is cleared first if the message wouldn't fit in it
+//Take in the renderer and printf style message
+//returns nothing
+void render_text(struct render * r, const char * fmt, ...)
+{
+	char text[RENDER_FRAME_MAX];
+	char line[32];
+	va_list args;
+	int lines = 0;
+	int len;
+	int i;
+
+	if (r->fd < 0)
+	{
+		return;
+	}
+	va_start(args, fmt);
+	len = vsnprintf(text, sizeof(text), fmt, args);
+	va_end(args);
+	if (len >= (int)sizeof(text))
+	{
+		len = sizeof(text) - 1;
+	}
+
+	if (r->ansi && r->drawn)
+	{
+		for (i = 0; i < len; i++)
+		{
+			lines += (text[i] == '\n');
+		}
+		if (r->text_lines + lines >= TEXT_LINES)
+		{
+			i = snprintf(line, sizeof(line), "\033[%d;1H\033[J", TEXT_TOP);
+			render_append(r, line, i);
+			r->text_lines = 0;
+		}
+		r->text_lines += lines;
+	}
+	render_append(r, text, len);
+}
+
+//Notes a line the user typed, the terminal's echo of it takes a row of the message area
+//Take in the renderer
+//returns nothing
+void render_typed(struct render * r)
+{
+	r->text_lines++;
+}
+
+//Writes the frame out in one write
+//Take in the renderer
+//returns nothing
+void render_flush(struct render * r)
+{
+	int done = 0;
+	int n;
+
+	while (done < r->len)
+	{
+		n = write(r->fd, r->frame + done, r->len - done);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			break; //nowhere to draw, drop the frame
+		}
+		done += n;
+	}
+	r->len = 0;
+}
@@ -0,0 +1,38 @@
+#ifndef PROG1_RENDER_H
+#define PROG1_RENDER_H
+
+/*------------------------------------------------------------------------
+* Client screen output.
+*
+* Boards and messages are collected into one frame buffer and written
+* with a single write() by render_flush. On a terminal the first board
+* clears the screen, and later boards only redraw the cells that changed
+* using cursor addressing. Messages go in the area under the board,
+* which is cleared with every new board and again whenever it fills up,
+* so the terminal never scrolls. Anything that isn't a terminal
+* gets the whole board as plain text each time. A renderer set up with
+* fd -1 draws nothing, for headless clients.
+*------------------------------------------------------------------------
+*/
+
+#define RENDER_FRAME_MAX 4096
+
+struct render {
+	int fd; /* where frames are written, -1 for none */
+	int ansi; /* fd is a terminal, redraw in place */
+	int drawn; /* shown holds what's on screen */
+	char title[64]; /* line above the board */
+	char shown[42]; /* board as last drawn */
+	int text_lines; /* rows used in the message area under the board */
+	char frame[RENDER_FRAME_MAX];
+	int len;
+};
+
+void render_init(struct render * r, int fd);
+void render_title(struct render * r, const char * title);
+void render_board(struct render * r, char * game_board);
+void render_text(struct render * r, const char * fmt, ...);
+void render_typed(struct render * r);
+void render_flush(struct render * r);
+
+#endif
@@ -0,0 +1,241 @@
+#include "prog1_rules.h"
+
+//Plays a move on the board if it is legal for the game type
+//Take in the game type, 2 byte move ('A' or 'P' followed by a column), game board and active player number
+//returns 1 if the move was made, -1 if it was invalid
+int apply_move(char game_type, char * player_move, char * game_board, int player_number)
+{
+	int player_desired_spot;
+
+	player_desired_spot = player_move[1] - '0';
+	if (player_move[0] == 'A')
+	{
+		return player_move_standard(player_desired_spot, game_board, player_number);
+	}
+	else if (player_move[0] == 'P' && game_type == 'P' && player_desired_spot >= 0 && player_desired_spot <= 6)
+	{
+		return player_move_popout(player_desired_spot, game_board, player_number);
+	}
+	return -1;
+}
+
+//Checks the board for the game type's win rule
+//Take in the game type, game board and active player number
+//returns 1 if the player lined up their tokens (a loss in antistack), 2 for a tie, -1 otherwise
+int check_winner(char game_type, char * game_board, int player_number)
+{
+	if (game_type == 'K')
+	{
+		return check_winner_antistack(game_board, player_number);
+	}
+	return check_winner_standard(game_board, player_number);
+}
+
+//Checks to see if move was valid
+//Take in the the desired spot the player wants their token to go, game board and active player number
+//returns if it was successful or not
+int player_move_standard(int desired_player_move, char * game_board, int playerNumber)
+{
+	int max_size;
+	max_size = 41;
+	int i;
+	int current_working_spot;
+	current_working_spot = 100;
+	if (!(desired_player_move <= 6 && desired_player_move >= 0))
+	{
+		return -1;
+	}
+	for (i = desired_player_move; i <= max_size; i += 7)
+	{
+		if (game_board[i] == '0')
+		{
+			current_working_spot = i;
+		}
+	} 
+	if (current_working_spot == 100)
+	{
+		return -1;
+	}	 
+	else
+	{
+		game_board[current_working_spot] = (char)(((int)'0')+playerNumber); //converts to char
+		return 1;
+	}	
+}
+
+//checks player move for validity in popout game
+//Take in the the desired spot the player wants their token to be popped out, game board and active player number
+//returns a status code
+int player_move_popout(int player_desired_spot, char * game_board, int player_number)
+{
+	int value_at_bottom;
+	//int converted_player_number;
+	int bottom_index;
+	//converted_player_number = 0;
+	bottom_index = player_desired_spot + 35;
+	//converted_player_number = player_number - '0';
+	value_at_bottom = game_board[(player_desired_spot + 35)] - '0'; //changes to number
+	if (player_number  == value_at_bottom)
+	{
+		int i;
+		i=0;
+		for (i=0; i < 29; i += 7)
+		{
+				game_board[bottom_index - i] = game_board[bottom_index - i -7];
+		}
+		game_board[player_desired_spot] = '0';
+		return 1;
+	}
+	else
+	{
+		return -1;
+	}
+}
+
+//Check to see if their is a winner for standard and popout game types
+//Take in the game board and active player number
+//returns a status code
+int check_winner_standard(char * game_board, int player_number)
+{
+	int row;
+	int col;
+	char active_player;
+	active_player = (char)(((int)'0') + player_number);
+	//Check Vertical Win
+	for (col = 0; col <= 6; col ++)
+	{
+		row = 0;
+		for (row = 0; row <= 14; row+=7)
+		{		
+			if (game_board[row+col] == active_player && game_board[row+col+7] == active_player && game_board[row+col+14] == active_player && game_board[row+col+21] == active_player)
+			{
+				return 1;			
+			} 
+		} 
+	}
+	
+	//Check Horizontal Win 	
+	for (row=0; row < 42; row+=7)
+	{
+		col = 0;
+		for (col=0; col < 4; col ++)
+		{		
+			if (game_board[row+col] == active_player && game_board[row+col+1] == active_player && game_board[row+col+2] == active_player && game_board[row+col+3] == active_player)  	
+			{
+				return 1;				
+			}
+		}
+	}
+	
+	//check diag win
+	for (row=0; row < 4; row ++)
+	{
+		col = 0;
+		for (col = 0; col < 17; col += 7)
+		{
+			if (game_board[row+col] == active_player && game_board[row+col+8] == active_player && game_board[row+col+16] == active_player && game_board[row+col+24] == active_player)
+			{
+				return 1;
+			}  	
+		}
+	}
+	//check diag win 2
+	for (row=21; row < 25; row ++)
+	{
+		col = 0;
+		for (col = 0; col < 18; col += 7)
+		{
+			if (game_board[row+col] == active_player && game_board[row+col-6] == active_player && game_board[row+col-12] == active_player && game_board[row+col-18] == active_player)
+			{
+				return 1;
+			}  	
+		}
+	}
+
+	//CHECK FOR TIE
+	int tie = 20;
+	row = 0;
+	for (row = 0; row < 7; row ++)
+	{
+		if (game_board[row] == '0')
+		{
+			return -1; //not a tie
+		} 
+	}	
+	//returns 2 for tie
+	return 2; 
+}
+
+//Check to see if their is a winner for antistack game
+//Take in the game board and active player number
+//returns a status code
+int check_winner_antistack(char * game_board, int player_number)
+{
+	int row;
+	int col;
+	char active_player;
+	active_player = (char)(((int)'0') + player_number);
+	//Check Vertical Win
+	for (col = 0; col <= 6; col ++)
+	{
+		row = 0;
+		for (row = 0; row <= 21; row+=7)
+		{		
+			if (game_board[row+col] == active_player && game_board[row+col+7] == active_player && game_board[row+col+14] == active_player)
+			{
+				return 1;			
+			} 
+		} 
+	}
+	
+	//Check Horizontal Win 	
+	for (row=0; row < 42; row+=7)
+	{
+		col = 0;
+		for (col=0; col < 5; col ++)
+		{		
+			if (game_board[row+col] == active_player && game_board[row+col+1] == active_player && game_board[row+col+2] == active_player)  	
+			{
+				return 1;				
+			}
+		}
+	}
+	
+	//check diag win
+	for (row=0; row < 5; row ++)
+	{
+		col = 0;
+		for (col = 0; col < 22; col += 7)
+		{
+			if (game_board[row+col] == active_player && game_board[row+col+8] == active_player && game_board[row+col+16] == active_player)
+			{
+				return 1;
+			}  	
+		}
+	}
+	//check diag win 2
+	for (row=14; row < 18; row ++)
+	{
+		col = 0;
+		for (col = 0; col < 23; col += 7)
+		{
+			if (game_board[row+col] == active_player && game_board[row+col-6] == active_player && game_board[row+col-12] == active_player)
+			{
+				return 1;
+			}  	
+		}
+	}
+
+	//CHECK FOR TIE
+	int tie = 20;
+	row = 0;
+	for (row = 0; row < 7; row ++)
+	{
+		if (game_board[row] == '0')
+		{
+			return -1; //not a tie
+		} 
+	}	
+	//returns 2 for tie
+	return 2; 
+}
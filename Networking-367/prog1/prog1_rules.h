@@ -0,0 +1,21 @@
+#ifndef PROG1_RULES_H
+#define PROG1_RULES_H
+
+/*------------------------------------------------------------------------
+* Connect 4 rules shared by the server and anything else that needs to
+* play or judge a game.
+*
+* The board is 42 chars, row major from the top left, '0' for an empty
+* cell and '1' / '2' for player tokens. Game types are 'S' standard,
+* 'P' popout and 'K' antistack.
+*------------------------------------------------------------------------
+*/
+
+int player_move_standard(int desired_player_move, char * game_board, int playerNumber);
+int player_move_popout(int player_desired_spot, char * game_board, int player_number);
+int check_winner_standard(char * game_board, int player_number);
+int check_winner_antistack(char * game_board, int player_number);
+int apply_move(char game_type, char * player_move, char * game_board, int player_number);
+int check_winner(char game_type, char * game_board, int player_number);
+
+#endif
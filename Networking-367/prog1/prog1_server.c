@@ -1,3 +1,4 @@
+#define _GNU_SOURCE /* struct ucred for SO_PEERCRED */
 #include <sys/types.h> 
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -7,8 +8,21 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "prog1_rules.h"
+#include "prog1_hint.h"
+#include "prog1_net.h"
+#include "prog1_cluster.h"
+#include "prog1_trace.h"
 
-#define QLEN 6 /* size of request queue */
+#define PREMOVE_MAX 8 /* premoves a player can have waiting */
+#define UPGRADE_VERSION 1 /* bump whenever struct upgrade_msg changes */
+#define HANDED_OVER 3 /* exit status of a game child that moved to the new server */
 
 /*------------------------------------------------------------------------
 * Program: server
@@ -19,9 +33,41 @@
 * (3) fork child game process and let users play Connect 4
 * (4) go back to step (1)
 *
-* Syntax: server [ port ] [ game type ]
+* Premoves: a player may queue "QA3A4" at any time, meaning "if the
+* opponent plays A3, play A4". When the opponent's move matches a queued
+* premove the server plays it straight away instead of sending 'Y' and
+* waiting on the reply. Premoves only answer the opponent's next move,
+* so any sent during the player's own turn are dropped when they move.
+* If the matching premove's reply is illegal the player gets 'R' and
+* the reply back, then their turn as usual.
+*
+* Hints: the player on move may send "?" to get back 'E', the best move
+* and its evaluation (see prog1_hint.h), and keep thinking. Given a
+* hint port, the server also answers hint requests from other tools.
+*
+* Cluster node: with --node the server skips its own lobby, connects to
+* a coordinator's Unix socket and plays the pairs it is handed, reporting
+* how many games it is running (see prog1_coordinator.c).
+*
+* Upgrades: SIGUSR2 starts the binary at argv[0] again with the same
+* arguments and hands it everything over a Unix socket with SCM_RIGHTS:
+* first the listening sockets and any player waiting in the lobby, then
+* each running game's sockets and state as the game next waits on a
+* player. Nobody is disconnected. The old server exits once all its games
+* have moved and the new one logs how long the handover took. Only the
+* old server and its own game children are let onto the handover socket.
+* Cluster nodes can't be upgraded this way, they log SIGUSR2 and carry on.
+*
+* Tracing: each process records accepts, pairing and every step of each
+* turn in a flight recorder. SIGUSR1 dumps it, and a game dumps it by
+* itself the first time a turn runs past C4_TRACE_SLOW_US (see
+* prog1_trace.h).
+*
+* Syntax: server [ port ] [ game type ] [ hint port ]
+*         server --node [ coordinator socket ] [ hint port ]
 *
 * port - protocol port number to use
+* hint port - optional port for the hint service
 *
 * Note: The port argument is optional. If no port is specified,
 * the server uses the default given by PROTOPORT.
@@ -31,30 +77,134 @@
 *------------------------------------------------------------------------
 */
 
+struct premove {
+	char opponent_move[2]; /* move the opponent has to play */
+	char reply_move[2]; /* move to answer it with */
+};
+
+struct premove_queue {
+	struct premove moves[PREMOVE_MAX];
+	int count;
+};
+
+struct game_state {
+	char game_type;
+	char game_board[47]; /* buffer for string the server sends */
+	int active; /* index of the player whose turn it is */
+	int premoved; /* active player's move was already played from their premove queue */
+	int turn_sent; /* both players already have this turn's status and board */
+	char last_move[2];
+	struct premove_queue premoves[2]; /* premoves queued by each player */
+};
+
+#define UPGRADE_LISTENERS 'L' /* old -> new: lobby, hint and waiting player sockets */
+#define UPGRADE_READY 'R' /* new -> old: listeners taken, go ahead */
+#define UPGRADE_GAME 'G' /* old game child -> new: both player sockets */
+#define UPGRADE_DONE 'D' /* old -> new: every old game has finished or moved */
+
+struct upgrade_msg {
+	char kind;
+	int version;
+	int has_hint; /* LISTENERS: hint listener follows the lobby listener */
+	int has_waiting; /* LISTENERS: lobby's waiting player comes last */
+	long long started_ns; /* LISTENERS: when the old server got SIGUSR2 */
+	int handed_over; /* DONE: games the old server passed across */
+	struct game_state game; /* GAME */
+};
+
+struct adoption {
+	int sd; /* Unix socket old games connect to, -1 when not taking over */
+	int control; /* connection to the old server */
+	int adopted;
+	int expected; /* games the old server handed over, -1 until it says */
+	long long started_ns;
+	int old_pid; /* server being taken over, games must be its children */
+};
+
+char ** saved_argv; /* to start the new binary with on upgrade */
+char game_type;
+int lobby_sd = -1; /* listening socket players connect to */
+int hint_sd = -1; /* hint service listening socket, -1 if none */
+int waiting_player = -1; /* player one while they wait for an opponent */
+unsigned long waiting_mark; /* trace mark from when the waiting player was accepted */
+int games_paired; /* games this process has started */
+int coordinator_sd = -1; /* node mode's connection to the coordinator */
+struct hint_cache * hints; /* shared best move cache */
+int hint_pid; /* hint service process, 0 if none */
+int successor_pid; /* new server started by an upgrade, 0 if none */
+int upgrade_pipe[2] = { -1, -1 }; /* games watch the read end, closing the write end moves them */
+int wake_pipe[2] = { -1, -1 }; /* signal handlers write a byte here to wake this process's poll */
+struct adoption adoption = { -1, -1, 0, -1, 0, 0 };
+volatile sig_atomic_t live_games; /* games running in children */
+volatile sig_atomic_t handed_over; /* children that exited with HANDED_OVER */
+volatile sig_atomic_t upgrade_requested;
+
 // Protos
-int player_move_standard(int desired_player_move, char * game_board, int playerNumber);
-int check_winner_standard(char * game_board, int player_number);
-int player_move_popout(int player_desired_spot, char * game_board, int player_number);
-int check_winner_antistack(char * game_board, int player_number);
+int start_hints(int sd);
+void node_main(char * path, char * hint_port);
+void reap_games(int sig);
+void wake_init(void);
+void wake_up(void);
+void wake_drain(void);
+void request_upgrade(int sig);
+void refuse_upgrade(int sig);
+void hint_main(int hint_sd);
+void lobby_accept(void);
+void start_game(int * players, struct game_state * state, unsigned long mark);
+void new_game(char game_type, struct game_state * state);
+void run_game(int * players, struct game_state * state);
+void upgrade(void);
+void take_over(int sd);
+void adopt_game(void);
+void adoption_done(void);
+int open_upgrade_listener(int pid);
+int connect_upgrade(int pid);
+int upgrade_peer_ok(int sd, int pid, int parent);
+void hand_over(int * players, struct game_state * state);
+long long now_ns(void);
+void send_hint(int sd, char game_type, char * game_board, int player_number);
+void send_premove_failed(int sd, char * reply_move);
+void send_status(int sd, char status, char * game_board, int player_number);
+int recv_move(int sd, char * player_move, struct premove_queue * queue);
+int wait_for_player(int sd);
+void drain_premoves(int sd, struct premove_queue * queue);
+void queue_premove(struct premove_queue * queue, char * premove);
+int take_premove(struct premove_queue * queue, char * opponent_move, char * player_move);
 
 // Main
 int main(int argc, char **argv) {
-	struct protoent *ptrp; /* pointer to a protocol table entry */
-	struct sockaddr_in sad; /* structure to hold server's address */
-	struct sockaddr_in cad; /* structure to hold client's address */
-	int sd, player1, player2; /* socket descriptors */
-	int port; /* protocol port number */
-	int alen; /* length of address */
-	char game_board[47]; /* buffer for string the server sends */
-	char game_type;
+	struct sigaction sa;
+	struct pollfd pfds[4];
+	int n;
+	int i;
 	
-	if( argc != 3 ) {
+	if( argc != 3 && argc != 4 ) {
 		fprintf(stderr,"Error: Wrong number of arguments\n");
 		fprintf(stderr,"usage:\n");
-		fprintf(stderr,"./server server_port game_type\n");
+		fprintf(stderr,"./server server_port game_type [hint_port]\n");
+		fprintf(stderr,"./server --node coordinator_socket [hint_port]\n");
 		exit(EXIT_FAILURE);
 	}
 
+	// A player hanging up shouldn't take the lobby down with them
+	signal(SIGPIPE, SIG_IGN);
+
+	// Reap games ourselves so we know how many are running
+	wake_init();
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = reap_games;
+	sigaction(SIGCHLD, &sa, NULL);
+
+	trace_init();
+
+	if (strcmp(argv[1], "--node") == 0)
+	{
+		// SIGUSR2 would kill a node and orphan its games, say no instead
+		sa.sa_handler = refuse_upgrade;
+		sigaction(SIGUSR2, &sa, NULL);
+		node_main(argv[2], (argc == 4) ? argv[3] : NULL);
+	}
+
 	if (strcmp("standard", argv[2]) == 0) // standard
 	{
 		game_type = 'S';
@@ -73,521 +223,1041 @@ int main(int argc, char **argv) {
 		exit(EXIT_FAILURE);
 	}
 
-	memset((char *)&sad,0,sizeof(sad)); /* clear sockaddr structure */
-	sad.sin_family = AF_INET; /* set family to Internet */
-	sad.sin_addr.s_addr = INADDR_ANY; /* set the local IP address */
+	saved_argv = argv;
+	if (getenv("C4_UPGRADE_FD") != NULL)
+	{
+		take_over(atoi(getenv("C4_UPGRADE_FD")));
+		unsetenv("C4_UPGRADE_FD");
+	}
+	else
+	{
+		lobby_sd = open_listener(argv[1]);
+		if (argc == 4)
+		{
+			hint_sd = open_listener(argv[3]);
+		}
+	}
 
-	port = atoi(argv[1]); /* convert argument to binary */
-	if (port > 0) { /* test for illegal value */
-		sad.sin_port = htons((u_short)port);
-	} else { /* print error message and exit */
-		fprintf(stderr,"Error: Bad port number %s\n",argv[1]);
+	if (pipe(upgrade_pipe) < 0) {
+		perror("pipe");
 		exit(EXIT_FAILURE);
 	}
+	fcntl(upgrade_pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(upgrade_pipe[1], F_SETFD, FD_CLOEXEC);
+	sa.sa_handler = request_upgrade;
+	sigaction(SIGUSR2, &sa, NULL);
 
-	/* Map TCP transport protocol name to protocol number */
-	if ( ((long int)(ptrp = getprotobyname("tcp"))) == 0) {
-		fprintf(stderr, "Error: Cannot map \"tcp\" to protocol number");
-		exit(EXIT_FAILURE);
+	hint_pid = start_hints(lobby_sd);
+
+	/* Main server loop - accept and handle requests */
+	while (1) 
+	{
+		// Signals wake the poll below through the wake pipe, so nothing set here is missed
+		trace_check();
+		if (upgrade_requested)
+		{
+			upgrade_requested = 0;
+			upgrade();
+		}
+
+		n = 0;
+		pfds[n].fd = lobby_sd;
+		pfds[n++].events = POLLIN;
+		pfds[n].fd = wake_pipe[0];
+		pfds[n++].events = POLLIN;
+		if (adoption.sd >= 0)
+		{
+			pfds[n].fd = adoption.sd;
+			pfds[n++].events = POLLIN;
+		}
+		if (adoption.control >= 0)
+		{
+			pfds[n].fd = adoption.control;
+			pfds[n++].events = POLLIN;
+		}
+		if (poll(pfds, n, -1) < 0)
+		{
+			if (errno != EINTR)
+			{
+				perror("poll");
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+
+		for (i = 0; i < n; i++)
+		{
+			if (pfds[i].revents == 0)
+			{
+				continue;
+			}
+			if (pfds[i].fd == lobby_sd)
+			{
+				lobby_accept();
+			}
+			else if (pfds[i].fd == wake_pipe[0])
+			{
+				wake_drain();
+			}
+			else if (pfds[i].fd == adoption.sd)
+			{
+				adopt_game();
+			}
+			else if (pfds[i].fd == adoption.control)
+			{
+				adoption_done();
+			}
+		}
 	}
+}
 
-	/* Create a socket */
-	sd = socket(PF_INET, SOCK_STREAM, ptrp->p_proto);
-	if (sd < 0) {
-		fprintf(stderr, "Error: Socket creation failed\n");
+//Sets up the hint cache shared by every game child and the hint service
+//Take in a socket the hint process shouldn't keep
+//returns the hint process pid, 0 if there's no hint port
+int start_hints(int sd)
+{
+	int pid;
+
+	hints = hint_cache_create();
+	if (hint_sd < 0)
+	{
+		return 0;
+	}
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
 		exit(EXIT_FAILURE);
 	}
+	if (pid == 0)
+	{
+		wake_init();
+		close(sd);
+		close(waiting_player);
+		close(adoption.sd);
+		close(adoption.control);
+		close(upgrade_pipe[0]);
+		close(upgrade_pipe[1]);
+		hint_main(hint_sd);
+	}
+	return pid;
+}
+
+//Cluster node: plays the games a coordinator hands over instead of running a lobby
+//Take in the coordinator's Unix socket path and the hint port (NULL for none)
+//returns never
+void node_main(char * path, char * hint_port)
+{
+	struct sockaddr_un addr; /* coordinator's address */
+	struct cluster_msg msg;
+	struct game_state state;
+	struct pollfd pfds[2];
+	int fds[2]; /* player sockets passed with a game */
+	int nfds;
+	int reported = -1; /* live game count the coordinator last heard */
+	int games_started = 0;
 
-	/* Bind a local address to the socket */
-	if (bind(sd, (struct sockaddr *)&sad, sizeof(sad)) < 0) {
-		fprintf(stderr,"Error: Bind failed\n");
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	coordinator_sd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (coordinator_sd < 0 || connect(coordinator_sd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "Error: Cannot reach coordinator at %s\n", path);
 		exit(EXIT_FAILURE);
 	}
+	if (hint_port != NULL)
+	{
+		hint_sd = open_listener(hint_port);
+	}
+	hint_pid = start_hints(coordinator_sd);
 
-	/* Specify size of request queue */
-	if (listen(sd, QLEN) < 0) {
-		fprintf(stderr,"Error: Listen failed\n");
+	while (1)
+	{
+		trace_check();
+		if (live_games != reported)
+		{
+			reported = live_games;
+			msg.kind = CLUSTER_LOAD;
+			msg.live_games = reported;
+			msg.games_started = games_started;
+			send_fds(coordinator_sd, &msg, sizeof(msg), NULL, 0);
+		}
+		// A game ending after the check above still wakes the poll through the wake pipe
+		pfds[0].fd = coordinator_sd;
+		pfds[0].events = POLLIN;
+		pfds[1].fd = wake_pipe[0];
+		pfds[1].events = POLLIN;
+		if (poll(pfds, 2, -1) <= 0)
+		{
+			continue;
+		}
+		if (pfds[1].revents)
+		{
+			wake_drain();
+		}
+		if (pfds[0].revents == 0)
+		{
+			continue; //a game ended or a trace was asked for
+		}
+		nfds = recv_fds(coordinator_sd, &msg, sizeof(msg), fds, 2);
+		if (nfds < 0)
+		{
+			fprintf(stderr, "Error: Coordinator went away\n");
+			exit(EXIT_FAILURE); //running games carry on in their own processes
+		}
+		if (msg.kind != CLUSTER_GAME || nfds != 2)
+		{
+			while (nfds > 0)
+			{
+				close(fds[--nfds]);
+			}
+			continue;
+		}
+		new_game(msg.game_type, &state);
+		start_game(fds, &state, trace_mark());
+		games_started++;
+	}
+}
+
+//SIGCHLD handler, counts finished games and the ones that moved to a new server
+void reap_games(int sig)
+{
+	int saved_errno = errno;
+	int status;
+	int pid;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+	{
+		if (pid == hint_pid || pid == successor_pid)
+		{
+			continue;
+		}
+		live_games--;
+		if (WIFEXITED(status) && WEXITSTATUS(status) == HANDED_OVER)
+		{
+			handed_over++;
+		}
+	}
+	errno = saved_errno;
+	wake_up();
+}
+
+//Gives this process its own wake pipe, forked children call it so they don't wake their parent
+//A signal that lands between a loop's checks and its poll would be missed without it
+//returns nothing
+void wake_init(void)
+{
+	close(wake_pipe[0]);
+	close(wake_pipe[1]);
+	if (pipe(wake_pipe) < 0) {
+		perror("pipe");
 		exit(EXIT_FAILURE);
 	}
+	fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+	fcntl(wake_pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(wake_pipe[1], F_SETFD, FD_CLOEXEC);
+	trace_wake_fd = wake_pipe[1];
+}
 
-	// PID for the forked child process
-	int cpid = 0;	
+//Wakes the process's poll loop, safe in a signal handler
+//A full pipe already has a wakeup waiting so a failed write doesn't matter
+void wake_up(void)
+{
+	int saved_errno = errno;
+	char byte = 0;
 
-	/* Main server loop - accept and handle requests */
-	while (1) 
+	write(wake_pipe[1], &byte, 1);
+	errno = saved_errno;
+}
+
+//Empties the wake pipe once the loop has woken, it rechecks its flags itself
+void wake_drain(void)
+{
+	char buf[64];
+
+	while (read(wake_pipe[0], buf, sizeof(buf)) > 0)
 	{
-		alen = sizeof(cad);
+	}
+}
 
-		//Guest 1
-		if ( (player1=accept(sd, (struct sockaddr *)&cad, &alen)) < 0) {
-			fprintf(stderr, "Error: Accept failed\n");
+//SIGUSR2 handler, the main loop does the upgrade
+void request_upgrade(int sig)
+{
+	upgrade_requested = 1;
+	wake_up();
+}
+
+//SIGUSR2 handler for cluster nodes, which can't be upgraded
+void refuse_upgrade(int sig)
+{
+	static const char msg[] = "upgrade: not supported in node mode, ignored\n";
+	int saved_errno = errno;
+
+	write(STDERR_FILENO, msg, sizeof(msg) - 1);
+	errno = saved_errno;
+}
+
+//Hint service process, forks a child per connection like the game lobby
+//Take in the hint listening socket
+//returns never
+void hint_main(int hint_sd)
+{
+	struct pollfd pfds[2];
+	int sd;
+
+	// Connections clean up after themselves, only the server counts games
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGTERM, SIG_DFL);
+	pfds[0].fd = hint_sd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = wake_pipe[0];
+	pfds[1].events = POLLIN;
+	while (1)
+	{
+		trace_check();
+		if (poll(pfds, 2, -1) < 0 && errno != EINTR) {
+			fprintf(stderr, "Error: Hint poll failed\n");
 			exit(EXIT_FAILURE);
 		}
-		char playerNumber;
-		playerNumber = '2';
-		send(player1, &game_type, 1, 0);
-		send(player1, &playerNumber, 1, 0);
-		
-		//Guest 2
-		if ( (player2=accept(sd, (struct sockaddr *)&cad, &alen)) < 0) {
-			fprintf(stderr, "Error: Accept failed\n");
+		if (pfds[1].revents)
+		{
+			wake_drain();
+		}
+		if (pfds[0].revents == 0)
+		{
+			continue;
+		}
+		if ((sd = accept(hint_sd, NULL, NULL)) < 0) {
+			fprintf(stderr, "Error: Hint accept failed\n");
 			exit(EXIT_FAILURE);
 		}
-		send(player2, &game_type, 1, 0);
-		
-
-		// Tell system to clean up zombie children
-		signal(SIGCHLD, SIG_IGN);
-
-		// Fork a child
-		cpid = fork();
-		if (cpid <0) {
-			perror("fork");
-			return;
-		}
-
-		// Child does the work -- GAME TIME!!!!
-		if (cpid == 0)
-		{			
-			memset(&game_board, '0', sizeof(game_board)); //board set to all zero's
-			int temp_sd;
-			temp_sd = 0;
-			int active_player;
-			active_player = player1; //player one goes first
-			int inactive_player;
-			inactive_player = player2;
-			int player_number;
-			player_number = 1;
-			char your_turn;
-			your_turn = 'Y';
-			char wait_turn;
-			wait_turn = 'H';
-			char invalid_move;
-			invalid_move = 'I';
-			int go = 1; 
-			int win_status = 50;
-			char playerMove[2];
-			int valid_move;
-			char win;
-			win = 'W';
-			char lose;
-			lose = 'L';
-			char tie;
-			tie = 'T';
-			int player_desired_spot;
-			//Standard Game			
-			if (game_type == 'S')
-			{			
-				while (go == 1)
-				{
-					send(active_player, &your_turn, 1, 0); //Send your turn to active player
-					send(active_player, &game_board, 42, 0);
-					send(inactive_player, &wait_turn, 1, 0); //Send hold to inactive player
-					send(inactive_player, &game_board, 42, 0);
-					
-					//get move from active player
-					recv(active_player, &playerMove, 2, 0);
-					if (playerMove[0] == 'A' && playerMove[2] == 0)
-					{
-						//Get Row Number
-						player_desired_spot = playerMove[1] - '0';
-						//check if move is valid
-						valid_move = player_move_standard(player_desired_spot, game_board, player_number);
-						while (valid_move == -1)
-						{
-							send(active_player, &invalid_move, 1, 0);
-							recv(active_player, &playerMove, 2, 0);
-							player_desired_spot = 0;
-							player_desired_spot = playerMove[1] - '0';
-							valid_move = player_move_standard(player_desired_spot, game_board, player_number);
-						} 
-						win_status = check_winner_standard(game_board, player_number);
-						if (win_status == 1) //win detected
-						{
-							send(active_player, &win, 1, 0);
-							send(inactive_player, &lose, 1, 0);
-							go = 0;
-							close(active_player);
-							close(inactive_player);
-							exit(EXIT_FAILURE); 
-						}
-						else if (win_status == 2)  //tie detected
-						{
-							send(active_player, &tie, 1, 0);
-							send(active_player, &tie, 1, 0);	
-							close(active_player);
-							close(inactive_player);
-							exit(0); 
-						}	
-					}
-					else if (playerMove[0] == 'P')
-					{
-						send(active_player, &invalid_move, 1, 0); //invalid move
-					}
-					else 
-					{
-						send(active_player, &invalid_move, 1, 0); //invalid move
-					}
-
-					//set player number for next round
-					if (player_number == 1)
-					{
-						player_number = 2;
-					}
-					else
-					{
-						player_number = 1;
-					}
-					temp_sd = active_player;
-					active_player = inactive_player;
-					inactive_player = temp_sd;
-				}
-			} //end standard game
-			else if (game_type == 'P') //start popout
-			{
-				while (go == 1)
-				{
-					send(active_player, &your_turn, 1, 0); //Send your turn to active player
-					send(active_player, &game_board, 42, 0);
-					send(inactive_player, &wait_turn, 1, 0); //Send hold to inactive player
-					send(inactive_player, &game_board, 42, 0);
-					
-					
-					while (go == 1) //while active player's turn
-					{
-						//get move from active player
-						recv(active_player, &playerMove, 2, 0);	
-						player_desired_spot = playerMove[1] - '0';
-						if (playerMove[0] == 'A' && playerMove[2] == 0)
-						{
-							valid_move = player_move_standard(player_desired_spot, game_board, player_number);
-						}
-						else if (playerMove[0] == 'P' && playerMove[2] == 0)
-						{
-							valid_move = player_move_popout(player_desired_spot, game_board, player_number);
-						}
-						if (valid_move == 1) //yes it was a valid move
-						{
-							go = 2; //break out of loop
-							win_status = check_winner_standard(game_board, player_number);
-							if (win_status == 1) //win detected
-							{
-								send(active_player, &win, 1, 0);
-								send(inactive_player, &lose, 1, 0);
-								go = 0;
-								close(active_player);
-								close(inactive_player);
-								exit(0); 
-							}
-							else if (win_status == 2)  //tie detected
-							{
-								send(active_player, &tie, 1, 0);
-								send(active_player, &tie, 1, 0);	
-								close(active_player);
-								close(inactive_player);
-								exit(0); 
-							}	
-						}
-						else
-						{
-							send(active_player, &invalid_move, 1, 0);
-						}
-						
-					}
-					go = 1; //reset go
-	
-					//set player number for next round
-					if (player_number == 1)
-					{
-						player_number = 2;
-					}
-					else
-					{
-						player_number = 1;
-					}
-					temp_sd = active_player;
-					active_player = inactive_player;
-					inactive_player = temp_sd;
-				}
-			}//end popout
-			//start antistack
-			else if (game_type == 'K')
-			{
-				while (go == 1)
-				{
-					send(active_player, &your_turn, 1, 0); //Send your turn to active player
-					send(active_player, &game_board, 42, 0);
-					send(inactive_player, &wait_turn, 1, 0); //Send hold to inactive player
-					send(inactive_player, &game_board, 42, 0);
-					
-					//get move from active player
-					recv(active_player, &playerMove, 2, 0);
-					if (playerMove[0] == 'A' && playerMove[2] == 0)
-					{
-						//Get Row Number
-						player_desired_spot = playerMove[1] - '0';
-						//check if move is valid
-						valid_move = player_move_standard(player_desired_spot, game_board, player_number);
-						while (valid_move == -1)
-						{
-							send(active_player, &invalid_move, 1, 0);
-							recv(active_player, &playerMove, 2, 0);
-							player_desired_spot = 0;
-							player_desired_spot = playerMove[1] - '0';
-							valid_move = player_move_standard(player_desired_spot, game_board, player_number);
-						} 
-						win_status = check_winner_antistack(game_board, player_number);
-						if (win_status == 1) //win detected
-						{
-							send(active_player, &lose, 1, 0);
-							send(inactive_player, &win, 1, 0);
-							go = 0;
-							close(active_player);
-							close(inactive_player);
-							exit(EXIT_FAILURE); 
-						}
-						else if (win_status == 2)  //tie detected
-						{
-							send(active_player, &tie, 1, 0);
-							send(active_player, &tie, 1, 0);	
-							close(active_player);
-							close(inactive_player);
-							exit(0); 
-						}	
-					}
-					else if (playerMove[0] == 'P')
-					{
-						send(active_player, &invalid_move, 1, 0); //invalid move
-					}
-					else 
-					{
-						send(active_player, &invalid_move, 1, 0); //invalid move
-					}
-
-					//set player number for next round
-					if (player_number == 1)
-					{
-						player_number = 2;
-					}
-					else
-					{
-						player_number = 1;
-					}
-					temp_sd = active_player;
-					active_player = inactive_player;
-					inactive_player = temp_sd;
-				}	
-			}
+		if (fork() == 0)
+		{
+			close(hint_sd);
+			close(wake_pipe[0]);
+			close(wake_pipe[1]);
+			trace_wake_fd = -1;
+			hint_serve(sd, hints);
+			exit(0);
 		}
-	}	
+		close(sd);
+	}
 }
 
+//Accepts a player into the lobby, starting a game once there are two
+//returns nothing
+void lobby_accept(void)
+{
+	struct game_state state;
+	int players[2];
+	char playerNumber;
+	unsigned long mark;
+	int player;
+
+	if ((player = accept(lobby_sd, NULL, NULL)) < 0) {
+		if (errno != EINTR)
+		{
+			fprintf(stderr, "Error: Accept failed\n");
+		}
+		return;
+	}
+	mark = trace_mark();
+	trace(TRACE_ACCEPT, (waiting_player < 0) ? 1 : 2, player);
+	send(player, &game_type, 1, 0);
+	if (waiting_player < 0)
+	{
+		//Guest 1
+		playerNumber = '2';
+		send(player, &playerNumber, 1, 0);
+		waiting_player = player;
+		waiting_mark = mark;
+		return;
+	}
+
+	//Guest 2
+	players[0] = waiting_player;
+	players[1] = player;
+	waiting_player = -1;
+	new_game(game_type, &state);
+	start_game(players, &state, waiting_mark);
+}
 
-//Checks to see if move was valid
-//Take in the the desired spot the player wants their token to go, game board and active player number
-//returns if it was successful or not
-int player_move_standard(int desired_player_move, char * game_board, int playerNumber)
+//Forks a child to play a game, new or picked up from an old server
+//Take in both player sockets, the game's state and a trace mark from before its players arrived
+//returns once the child is running, the parent no longer holds the players
+void start_game(int * players, struct game_state * state, unsigned long mark)
 {
-	int max_size;
-	max_size = 41;
-	int i;
-	int current_working_spot;
-	current_working_spot = 100;
-	if (!(desired_player_move <= 6 && desired_player_move >= 0))
+	sigset_t chld;
+	int cpid;
+
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &chld, NULL);
+	trace(TRACE_PAIR, 0, ++games_paired);
+
+	// Fork a child
+	cpid = fork();
+	if (cpid < 0) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+
+	// Child does the work -- GAME TIME!!!!
+	if (cpid == 0)
 	{
-		return -1;
+		sigprocmask(SIG_UNBLOCK, &chld, NULL);
+		wake_init();
+		trace_keep_from(mark); //the lobby's history of other games isn't ours
+		close(lobby_sd);
+		close(hint_sd);
+		close(waiting_player);
+		close(coordinator_sd);
+		close(adoption.sd);
+		close(adoption.control);
+		close(upgrade_pipe[1]);
+		run_game(players, state);
+		exit(0);
 	}
-	for (i = desired_player_move; i <= max_size; i += 7)
+	live_games++;
+	sigprocmask(SIG_UNBLOCK, &chld, NULL);
+
+	// Parent hands the players off to the child and goes back to the lobby
+	close(players[0]);
+	close(players[1]);
+}
+
+//Sets up the state for a game that hasn't started
+//Take in the game type and the state to fill in
+//returns nothing
+void new_game(char game_type, struct game_state * state)
+{
+	memset(state, 0, sizeof(*state));
+	memset(state->game_board, '0', sizeof(state->game_board)); //board set to all zero's
+	state->game_type = game_type;
+	state->active = 0; //player one goes first
+}
+
+//Plays a game between two connected players until it is won, tied or a player drops
+//Hands the game to a new server instead if an upgrade starts while waiting on a player
+//Take in both player sockets and the game's state
+//returns when the game is over
+void run_game(int * players, struct game_state * state)
+{
+	char * game_board = state->game_board;
+	char game_type = state->game_type;
+	int player_number;
+	int win_status;
+	int valid;
+	int got;
+	char player_move[2];
+	unsigned long long turn_start = 0; /* when the move being answered came in */
+
+	while (1)
 	{
-		if (game_board[i] == '0')
+		player_number = state->active + 1;
+		if (!state->turn_sent)
 		{
-			current_working_spot = i;
+			if (!state->premoved)
+			{
+				send_status(players[state->active], 'Y', game_board, player_number); //Send your turn to active player
+			}
+			send_status(players[!state->active], 'H', game_board, 3 - player_number); //Send hold to inactive player
+			state->turn_sent = 1;
 		}
-	} 
-	if (current_working_spot == 100)
+		trace_turn(turn_start);
+		turn_start = state->premoved ? trace_now() : 0;
+
+		//get move from active player, unless their premove already played it
+		while (!state->premoved)
+		{
+			got = recv_move(players[state->active], player_move, &state->premoves[state->active]);
+			if (got == 0)
+			{
+				hand_over(players, state);
+				continue; //new server isn't there after all, carry on here
+			}
+			if (got < 0)
+			{
+				close(players[0]);
+				close(players[1]);
+				return; //player dropped
+			}
+			turn_start = trace_now();
+			trace_at(turn_start, TRACE_RECV, player_number, player_move[0]);
+			if (player_move[0] == '?')
+			{
+				send_hint(players[state->active], game_type, game_board, player_number);
+				turn_start = 0; //hints aren't turns
+				continue;
+			}
+			valid = apply_move(game_type, player_move, game_board, player_number);
+			trace(TRACE_VALIDATE, player_number, valid);
+			if (valid == 1)
+			{
+				break;
+			}
+			send_status(players[state->active], 'I', NULL, player_number);
+			trace_turn(turn_start);
+			turn_start = 0;
+		}
+		if (!state->premoved)
+		{
+			memcpy(state->last_move, player_move, 2);
+			state->premoves[state->active].count = 0; //anything queued this turn answered a move already made
+		}
+
+		win_status = check_winner(game_type, game_board, player_number);
+		trace(TRACE_WIN_CHECK, player_number, win_status);
+		if (win_status == 1) //win detected, in antistack the mover just lost
+		{
+			send_status(players[state->active], (game_type == 'K') ? 'L' : 'W', NULL, player_number);
+			send_status(players[!state->active], (game_type == 'K') ? 'W' : 'L', NULL, 3 - player_number);
+			trace_turn(turn_start);
+			break;
+		}
+		else if (win_status == 2) //tie detected
+		{
+			send_status(players[state->active], 'T', NULL, player_number);
+			send_status(players[!state->active], 'T', NULL, 3 - player_number);
+			trace_turn(turn_start);
+			break;
+		}
+
+		//next player may have already answered this move
+		state->active = !state->active;
+		state->turn_sent = 0;
+		drain_premoves(players[state->active], &state->premoves[state->active]);
+		state->premoved = 0;
+		if (take_premove(&state->premoves[state->active], state->last_move, player_move) == 1)
+		{
+			state->premoved = apply_move(game_type, player_move, game_board, state->active + 1);
+			trace(TRACE_VALIDATE, state->active + 1, state->premoved);
+			if (state->premoved != 1)
+			{
+				state->premoved = 0;
+				send_premove_failed(players[state->active], player_move);
+			}
+		}
+		if (state->premoved)
+		{
+			memcpy(state->last_move, player_move, 2);
+		}
+	}
+	close(players[0]);
+	close(players[1]);
+}
+
+//Starts the binary at argv[0] and hands it the lobby and every running game
+//Carries on as before if the new server doesn't take the listeners
+//returns only if the upgrade didn't happen
+void upgrade(void)
+{
+	struct upgrade_msg msg;
+	sigset_t chld;
+	sigset_t old_mask;
+	char fd_arg[16];
+	int fds[3];
+	int nfds = 0;
+	int listen_sd;
+	int control;
+
+	if (adoption.sd >= 0)
 	{
-		return -1;
-	}	 
-	else
+		fprintf(stderr, "Error: Still taking over from the last server, upgrade ignored\n");
+		return;
+	}
+	listen_sd = open_upgrade_listener(getpid());
+	if (listen_sd < 0)
 	{
-		game_board[current_working_spot] = (char)(((int)'0')+playerNumber); //converts to char
-		return 1;
-	}	
+		return;
+	}
+	successor_pid = fork();
+	if (successor_pid < 0) {
+		perror("fork");
+		close(listen_sd);
+		return;
+	}
+	if (successor_pid == 0)
+	{
+		close(lobby_sd);
+		close(hint_sd);
+		close(waiting_player);
+		snprintf(fd_arg, sizeof(fd_arg), "%d", listen_sd);
+		setenv("C4_UPGRADE_FD", fd_arg, 1);
+		execv(saved_argv[0], saved_argv);
+		perror("execv");
+		exit(EXIT_FAILURE);
+	}
+	close(listen_sd);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.kind = UPGRADE_LISTENERS;
+	msg.version = UPGRADE_VERSION;
+	msg.started_ns = now_ns();
+	fds[nfds++] = lobby_sd;
+	if (hint_sd >= 0)
+	{
+		msg.has_hint = 1;
+		fds[nfds++] = hint_sd;
+	}
+	if (waiting_player >= 0)
+	{
+		msg.has_waiting = 1;
+		fds[nfds++] = waiting_player;
+	}
+	control = connect_upgrade(getpid());
+	if (control < 0 || send_fds(control, &msg, sizeof(msg), fds, nfds) < 0 ||
+		recv_fds(control, &msg, sizeof(msg), NULL, 0) < 0 || msg.kind != UPGRADE_READY)
+	{
+		fprintf(stderr, "Error: New server didn't start, carrying on\n");
+		close(control);
+		return;
+	}
+
+	// New server owns the lobby now, send every game after it
+	close(lobby_sd);
+	close(hint_sd);
+	close(waiting_player);
+	if (hint_pid > 0)
+	{
+		kill(hint_pid, SIGTERM);
+	}
+	close(upgrade_pipe[1]);
+
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &chld, &old_mask);
+	while (live_games > 0)
+	{
+		sigsuspend(&old_mask);
+	}
+	memset(&msg, 0, sizeof(msg));
+	msg.kind = UPGRADE_DONE;
+	msg.version = UPGRADE_VERSION;
+	msg.handed_over = handed_over;
+	send_fds(control, &msg, sizeof(msg), NULL, 0);
+	printf("upgrade: handed %d games to pid %d\n", (int)handed_over, successor_pid);
+	fflush(stdout);
+	exit(0);
 }
 
-//checks player move for validity in popout game
-//Take in the the desired spot the player wants their token to be popped out, game board and active player number
-//returns a status code
-int player_move_popout(int player_desired_spot, char * game_board, int player_number)
+//Picks up the lobby from the server that started us
+//Take in the Unix socket inherited from it
+//returns once the lobby is ours, exits if the handover isn't usable
+void take_over(int sd)
 {
-	int value_at_bottom;
-	//int converted_player_number;
-	int bottom_index;
-	//converted_player_number = 0;
-	bottom_index = player_desired_spot + 35;
-	//converted_player_number = player_number - '0';
-	value_at_bottom = game_board[(player_desired_spot + 35)] - '0'; //changes to number
-	if (player_number  == value_at_bottom)
-	{
-		int i;
-		i=0;
-		for (i=0; i < 29; i += 7)
-		{
-				game_board[bottom_index - i] = game_board[bottom_index - i -7];
-		}
-		game_board[player_desired_spot] = '0';
-		return 1;
+	struct upgrade_msg msg;
+	int fds[3];
+	int nfds;
+	int i = 0;
+
+	fcntl(sd, F_SETFD, FD_CLOEXEC);
+	adoption.old_pid = getppid();
+	while (1)
+	{
+		adoption.control = accept(sd, NULL, NULL);
+		if (adoption.control < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break; //recv_fds below reports it
+		}
+		if (upgrade_peer_ok(adoption.control, adoption.old_pid, -1))
+		{
+			break;
+		}
+		fprintf(stderr, "Error: Handover connection not from the old server, ignored\n");
+		close(adoption.control);
 	}
-	else
+	nfds = recv_fds(adoption.control, &msg, sizeof(msg), fds, 3);
+	if (nfds < 1 || msg.kind != UPGRADE_LISTENERS || msg.version != UPGRADE_VERSION ||
+		nfds != 1 + msg.has_hint + msg.has_waiting)
 	{
-		return -1;
+		fprintf(stderr, "Error: Unusable handover from the old server\n");
+		exit(EXIT_FAILURE);
 	}
+	lobby_sd = fds[i++];
+	if (msg.has_hint)
+	{
+		hint_sd = fds[i++];
+	}
+	if (msg.has_waiting)
+	{
+		waiting_player = fds[i++];
+		waiting_mark = trace_mark();
+	}
+	adoption.sd = sd;
+	adoption.adopted = 0;
+	adoption.expected = -1;
+	adoption.started_ns = msg.started_ns;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.kind = UPGRADE_READY;
+	msg.version = UPGRADE_VERSION;
+	send_fds(adoption.control, &msg, sizeof(msg), NULL, 0);
 }
 
-//Check to see if their is a winner for standard and popout game types
-//Take in the game board and active player number
-//returns a status code
-int check_winner_standard(char * game_board, int player_number)
+//Accepts a game from one of the old server's children and carries it on
+//returns nothing
+void adopt_game(void)
 {
-	int row;
-	int col;
-	char active_player;
-	active_player = (char)(((int)'0') + player_number);
-	//Check Vertical Win
-	for (col = 0; col <= 6; col ++)
-	{
-		row = 0;
-		for (row = 0; row <= 14; row+=7)
-		{		
-			if (game_board[row+col] == active_player && game_board[row+col+7] == active_player && game_board[row+col+14] == active_player && game_board[row+col+21] == active_player)
-			{
-				return 1;			
-			} 
-		} 
+	struct upgrade_msg msg;
+	int players[2];
+	int sd;
+	int nfds;
+
+	if ((sd = accept(adoption.sd, NULL, NULL)) < 0) {
+		return;
 	}
-	
-	//Check Horizontal Win 	
-	for (row=0; row < 42; row+=7)
+	if (!upgrade_peer_ok(sd, -1, adoption.old_pid))
 	{
-		col = 0;
-		for (col=0; col < 4; col ++)
-		{		
-			if (game_board[row+col] == active_player && game_board[row+col+1] == active_player && game_board[row+col+2] == active_player && game_board[row+col+3] == active_player)  	
-			{
-				return 1;				
-			}
+		fprintf(stderr, "Error: Game handover not from one of the old server's games, ignored\n");
+		close(sd);
+		return;
+	}
+	nfds = recv_fds(sd, &msg, sizeof(msg), players, 2);
+	close(sd); //lets the old game exit
+	if (nfds != 2 || msg.kind != UPGRADE_GAME || msg.version != UPGRADE_VERSION)
+	{
+		while (nfds > 0)
+		{
+			close(players[--nfds]);
 		}
+		return;
 	}
-	
-	//check diag win
-	for (row=0; row < 4; row ++)
+	start_game(players, &msg.game, trace_mark());
+	adoption.adopted++;
+	if (adoption.adopted == adoption.expected)
 	{
-		col = 0;
-		for (col = 0; col < 17; col += 7)
+		adoption_done();
+	}
+}
+
+//Reads the old server's final count, finishing the takeover once every game has arrived
+//returns nothing
+void adoption_done(void)
+{
+	struct upgrade_msg msg;
+
+	if (adoption.control >= 0)
+	{
+		if (recv_fds(adoption.control, &msg, sizeof(msg), NULL, 0) == 0 && msg.kind == UPGRADE_DONE)
 		{
-			if (game_board[row+col] == active_player && game_board[row+col+8] == active_player && game_board[row+col+16] == active_player && game_board[row+col+24] == active_player)
-			{
-				return 1;
-			}  	
+			adoption.expected = msg.handed_over;
 		}
+		else
+		{
+			adoption.expected = adoption.adopted; //old server died, nothing more is coming
+		}
+		close(adoption.control);
+		adoption.control = -1;
+	}
+	if (adoption.expected < 0 || adoption.adopted < adoption.expected)
+	{
+		return;
+	}
+	printf("upgrade: adopted %d games in %.3f ms\n", adoption.adopted, (now_ns() - adoption.started_ns) / 1e6);
+	fflush(stdout);
+	close(adoption.sd);
+	adoption.sd = -1;
+}
+
+//Creates the Unix socket an upgrade's new server takes games on
+//It lives in the abstract namespace under the old server's pid so games can find it
+//Take in the old server's pid
+//returns the listening socket, -1 on failure
+int open_upgrade_listener(int pid)
+{
+	struct sockaddr_un addr;
+	int len;
+	int sd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	len = snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "c4-upgrade-%d", pid);
+	sd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (sd < 0 || bind(sd, (struct sockaddr *)&addr, sizeof(sa_family_t) + 1 + len) < 0 ||
+		listen(sd, SOMAXCONN) < 0)
+	{
+		fprintf(stderr, "Error: Cannot create upgrade socket\n");
+		close(sd);
+		return -1;
 	}
-	//check diag win 2
-	for (row=21; row < 25; row ++)
+	return sd;
+}
+
+//Connects to the upgrade socket opened by the server with the given pid
+//returns the connection, -1 on failure
+int connect_upgrade(int pid)
+{
+	struct sockaddr_un addr;
+	int len;
+	int sd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	len = snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "c4-upgrade-%d", pid);
+	sd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (sd < 0)
 	{
-		col = 0;
-		for (col = 0; col < 18; col += 7)
+		return -1;
+	}
+	while (connect(sd, (struct sockaddr *)&addr, sizeof(sa_family_t) + 1 + len) < 0)
+	{
+		if (errno != EINTR)
 		{
-			if (game_board[row+col] == active_player && game_board[row+col-6] == active_player && game_board[row+col-12] == active_player && game_board[row+col-18] == active_player)
-			{
-				return 1;
-			}  	
+			close(sd);
+			return -1;
 		}
 	}
+	return sd;
+}
+
+//Checks who is on the other end of a handover connection
+//Take in the connection, the pid it must come from and the pid its parent must be, -1 for either
+//returns 1 if it's the same user and the pids match, 0 otherwise
+int upgrade_peer_ok(int sd, int pid, int parent)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	char path[32];
+	char stat[256];
+	char * end;
+	FILE * f;
+	int ppid = -1;
+
+	if (getsockopt(sd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 || cred.uid != getuid())
+	{
+		return 0;
+	}
+	if (pid >= 0 && cred.pid != pid)
+	{
+		return 0;
+	}
+	if (parent < 0)
+	{
+		return 1;
+	}
 
-	//CHECK FOR TIE
-	int tie = 20;
-	row = 0;
-	for (row = 0; row < 7; row ++)
+	// Parent pid is the field after the state, and the name before it may hold anything
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int)cred.pid);
+	f = fopen(path, "r");
+	if (f == NULL)
 	{
-		if (game_board[row] == '0')
+		return 0;
+	}
+	if (fgets(stat, sizeof(stat), f) != NULL && (end = strrchr(stat, ')')) != NULL)
+	{
+		sscanf(end + 1, " %*c %d", &ppid);
+	}
+	fclose(f);
+	return ppid == parent;
+}
+
+//Sends a game's sockets and state to the new server and leaves it to them
+//Waits for the new server to hang up first, it checks we're the old server's child while we're still here
+//Take in both player sockets and the game's state
+//returns only if the new server can't be reached, and stops watching for upgrades
+void hand_over(int * players, struct game_state * state)
+{
+	struct upgrade_msg msg;
+	char byte;
+	int sd;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.kind = UPGRADE_GAME;
+	msg.version = UPGRADE_VERSION;
+	msg.game = *state;
+	sd = connect_upgrade(getppid());
+	if (sd >= 0 && send_fds(sd, &msg, sizeof(msg), players, 2) == 1)
+	{
+		while (recv(sd, &byte, 1, 0) < 0 && errno == EINTR)
 		{
-			return -1; //not a tie
-		} 
-	}	
-	//returns 2 for tie
-	return 2; 
+		}
+		exit(HANDED_OVER);
+	}
+	close(sd);
+	close(upgrade_pipe[0]);
+	upgrade_pipe[0] = -1;
 }
 
-//Check to see if their is a winner for antistack game
-//Take in the game board and active player number
-//returns a status code
-int check_winner_antistack(char * game_board, int player_number)
+//returns CLOCK_MONOTONIC in nanoseconds, comparable between processes
+long long now_ns(void)
 {
-	int row;
-	int col;
-	char active_player;
-	active_player = (char)(((int)'0') + player_number);
-	//Check Vertical Win
-	for (col = 0; col <= 6; col ++)
-	{
-		row = 0;
-		for (row = 0; row <= 21; row+=7)
-		{		
-			if (game_board[row+col] == active_player && game_board[row+col+7] == active_player && game_board[row+col+14] == active_player)
-			{
-				return 1;			
-			} 
-		} 
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//Sends a player a status byte, and the board with it if there is one
+//Records the send in the flight recorder so a blocking send shows up
+//Take in the player's socket, the status, the board or NULL and the player's number
+//returns nothing
+void send_status(int sd, char status, char * game_board, int player_number)
+{
+	int sent;
+
+	trace(TRACE_SEND_QUEUED, player_number, status);
+	sent = send(sd, &status, 1, 0);
+	if (game_board != NULL && sent == 1)
+	{
+		sent += send(sd, game_board, 42, 0);
 	}
-	
-	//Check Horizontal Win 	
-	for (row=0; row < 42; row+=7)
+	trace(TRACE_SEND_DONE, player_number, sent);
+}
+
+//Sends the active player the best move for the current board
+//Take in their socket and the position
+//returns nothing
+void send_hint(int sd, char game_type, char * game_board, int player_number)
+{
+	struct hint_result result;
+	char reply[4];
+
+	hint_lookup(hints, game_type, player_number, game_board, &result);
+	reply[0] = 'E';
+	reply[1] = result.move[0];
+	reply[2] = result.move[1];
+	reply[3] = result.eval;
+	send(sd, reply, 4, 0);
+}
+
+//Tells a player their premove matched but its reply couldn't be played, 'Y' follows as usual
+//Take in their socket and the reply that was refused
+//returns nothing
+void send_premove_failed(int sd, char * reply_move)
+{
+	char reply[3];
+
+	reply[0] = 'R';
+	reply[1] = reply_move[0];
+	reply[2] = reply_move[1];
+	send(sd, reply, 3, 0);
+}
+
+//Reads messages from the active player until a move arrives
+//Premove messages ('Q' + opponent move + reply move) sent along the way are queued
+//returns 1 with the move in player_move, -1 if the player disconnected, 0 if an upgrade started first
+int recv_move(int sd, char * player_move, struct premove_queue * queue)
+{
+	char premove[5];
+
+	while (1)
 	{
-		col = 0;
-		for (col=0; col < 5; col ++)
-		{		
-			if (game_board[row+col] == active_player && game_board[row+col+1] == active_player && game_board[row+col+2] == active_player)  	
-			{
-				return 1;				
-			}
+		if (wait_for_player(sd) == 0)
+		{
+			return 0;
+		}
+		if (recv(sd, player_move, 2, MSG_WAITALL) != 2)
+		{
+			return -1;
 		}
+		if (player_move[0] != 'Q')
+		{
+			return 1;
+		}
+		premove[0] = player_move[0];
+		premove[1] = player_move[1];
+		if (recv(sd, premove + 2, 3, MSG_WAITALL) != 3)
+		{
+			return -1;
+		}
+		queue_premove(queue, premove);
 	}
-	
-	//check diag win
-	for (row=0; row < 5; row ++)
+}
+
+//Waits for a player to send something, watching for an upgrade at the same time
+//Nothing has been read when an upgrade interrupts, so the game can move mid turn
+//Dumps the flight recorder in between if SIGUSR1 asks for it
+//Take in the player's socket
+//returns 1 once the player has sent something, 0 if an upgrade started
+int wait_for_player(int sd)
+{
+	struct pollfd pfds[3];
+
+	pfds[0].fd = sd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = upgrade_pipe[0]; //ignored once it's -1
+	pfds[1].events = POLLIN;
+	pfds[2].fd = wake_pipe[0];
+	pfds[2].events = POLLIN;
+	while (1)
 	{
-		col = 0;
-		for (col = 0; col < 22; col += 7)
+		trace_check();
+		if (poll(pfds, 3, -1) < 0)
 		{
-			if (game_board[row+col] == active_player && game_board[row+col+8] == active_player && game_board[row+col+16] == active_player)
+			if (errno != EINTR)
 			{
-				return 1;
-			}  	
+				return 1; //let recv report the problem
+			}
+			continue;
+		}
+		if (pfds[2].revents)
+		{
+			wake_drain();
+		}
+		if (pfds[1].revents)
+		{
+			return 0;
+		}
+		if (pfds[0].revents)
+		{
+			return 1;
 		}
 	}
-	//check diag win 2
-	for (row=14; row < 18; row ++)
+}
+
+//Pulls any premoves the waiting player sent during the opponent's turn off their socket
+//Stops at the first message that isn't a premove so it's left for recv_move
+//returns nothing
+void drain_premoves(int sd, struct premove_queue * queue)
+{
+	char premove[5];
+
+	while (recv(sd, premove, 1, MSG_PEEK | MSG_DONTWAIT) == 1 && premove[0] == 'Q')
 	{
-		col = 0;
-		for (col = 0; col < 23; col += 7)
+		if (recv(sd, premove, 5, MSG_WAITALL) != 5)
 		{
-			if (game_board[row+col] == active_player && game_board[row+col-6] == active_player && game_board[row+col-12] == active_player)
-			{
-				return 1;
-			}  	
+			return; //dropped players are noticed on their next turn
 		}
+		queue_premove(queue, premove);
 	}
+}
 
-	//CHECK FOR TIE
-	int tie = 20;
-	row = 0;
-	for (row = 0; row < 7; row ++)
+//Adds a premove message to a player's queue
+//Premoves past PREMOVE_MAX are dropped
+//returns nothing
+void queue_premove(struct premove_queue * queue, char * premove)
+{
+	if (queue->count >= PREMOVE_MAX)
+	{
+		return;
+	}
+	memcpy(queue->moves[queue->count].opponent_move, premove + 1, 2);
+	memcpy(queue->moves[queue->count].reply_move, premove + 3, 2);
+	queue->count++;
+}
+
+//Looks up the premove answering the opponent's last move
+//Premoves only cover the opponent's next move so the queue is emptied either way
+//returns 1 with the reply in player_move if one matched, -1 otherwise
+int take_premove(struct premove_queue * queue, char * opponent_move, char * player_move)
+{
+	int i;
+	int found = -1;
+
+	for (i = 0; i < queue->count; i++)
 	{
-		if (game_board[row] == '0')
+		if (memcmp(queue->moves[i].opponent_move, opponent_move, 2) == 0)
 		{
-			return -1; //not a tie
-		} 
-	}	
-	//returns 2 for tie
-	return 2; 
+			memcpy(player_move, queue->moves[i].reply_move, 2);
+			found = 1;
+			break;
+		}
+	}
+	queue->count = 0;
+	return found;
 }
@@ -0,0 +1,217 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <string.h>
+#include <errno.h>
+#include "prog1_session.h"
+
+//Sets up a session on a connected socket
+//Take in the session, the socket, the front end's handler and its data
+//returns nothing
+void session_init(struct session * s, int sd, session_handler handler, void * user)
+{
+	memset(s, 0, sizeof(*s));
+	s->sd = sd;
+	s->handler = handler;
+	s->user = user;
+}
+
+//Works out how long the message at the front of the buffer is
+//returns its length, 0 if the status byte isn't one the server sends
+static int session_frame_len(struct session * s, char status)
+{
+	if (s->game_type == 0)
+	{
+		return 1; //game type
+	}
+	switch (status)
+	{
+	case 'Y':
+	case 'H':
+		return 43;
+	case 'E':
+		return 4;
+	case 'R':
+		return 3;
+	case '2':
+	case 'I':
+	case 'W':
+	case 'L':
+	case 'T':
+		return 1;
+	}
+	return 0;
+}
+
+//Reads whatever the server has sent and hands each whole message to the handler
+//Take in the session
+//returns 1 while the connection is open, 0 once it is closed or the game is over
+int session_read(struct session * s)
+{
+	char status;
+	int used = 0;
+	int len;
+	int n;
+
+	n = recv(s->sd, s->in + s->in_len, SESSION_IN_MAX - s->in_len, MSG_DONTWAIT);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+	{
+		return 1;
+	}
+	if (n <= 0)
+	{
+		return 0;
+	}
+	s->in_len += n;
+
+	while (used < s->in_len && !s->over)
+	{
+		status = s->in[used];
+		len = session_frame_len(s, status);
+		if (len == 0)
+		{
+			used++; //not ours, skip it
+			continue;
+		}
+		if (s->in_len - used < len)
+		{
+			break; //rest hasn't arrived yet
+		}
+		if (s->game_type == 0)
+		{
+			s->game_type = status;
+		}
+		else if (status == '2')
+		{
+			s->player_number = 1;
+		}
+		else
+		{
+			if (s->player_number == 0)
+			{
+				s->player_number = 2;
+			}
+			if (status == 'Y' || status == 'H')
+			{
+				memcpy(s->game_board, s->in + used + 1, 42);
+				s->my_turn = (status == 'Y');
+				if (status == 'H')
+				{
+					s->held_len = 0; //our move was taken and the premoves went after it
+				}
+			}
+			else if (status == 'I')
+			{
+				s->my_turn = 1;
+			}
+			else if (status == 'E')
+			{
+				s->hint[0] = s->in[used + 1];
+				s->hint[1] = s->in[used + 2];
+				s->hint_eval = (signed char)s->in[used + 3];
+			}
+			else if (status == 'R')
+			{
+				s->premove_failed[0] = s->in[used + 1];
+				s->premove_failed[1] = s->in[used + 2];
+			}
+			else
+			{
+				s->my_turn = 0;
+				s->over = 1;
+			}
+		}
+		used += len;
+		s->handler(s, status);
+	}
+	memmove(s->in, s->in + used, s->in_len - used);
+	s->in_len -= used;
+	return !s->over;
+}
+
+//Sends as much of the queued output as the socket takes
+//Take in the session
+//returns 1 if the connection is still fine, 0 if it failed
+int session_write(struct session * s)
+{
+	int n;
+
+	while (s->out_len > 0)
+	{
+		n = send(s->sd, s->out, s->out_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return (errno == EAGAIN || errno == EWOULDBLOCK);
+		}
+		memmove(s->out, s->out + n, s->out_len - n);
+		s->out_len -= n;
+	}
+	return 1;
+}
+
+//Queues bytes for the server and tries to send them right away
+static int session_queue(struct session * s, char * data, int len)
+{
+	if (s->out_len + len > SESSION_OUT_MAX)
+	{
+		return -1;
+	}
+	memcpy(s->out + s->out_len, data, len);
+	s->out_len += len;
+	return session_write(s) ? 1 : -1;
+}
+
+//Sends a move, only while it is our turn so stale input can't go out later
+//Premoves held during the turn follow it, they're kept in case the move is invalid
+//Take in the session and the 2 byte move
+//returns 1 if it was queued, -1 if it isn't our turn or the connection failed
+int session_move(struct session * s, char * move)
+{
+	if (!s->my_turn)
+	{
+		return -1;
+	}
+	s->my_turn = 0;
+	if (session_queue(s, move, 2) < 0)
+	{
+		return -1;
+	}
+	if (s->held_len > 0)
+	{
+		session_queue(s, s->held, s->held_len);
+	}
+	return 1;
+}
+
+//Sends a premove ("QA3A4"), or holds it until our move has gone out if it's our turn
+//Take in the session and the 5 byte premove
+//returns 1 if it was queued, 0 if it's held, -1 otherwise
+int session_premove(struct session * s, char * premove)
+{
+	if (s->my_turn)
+	{
+		if (s->held_len + 5 > SESSION_HELD_MAX)
+		{
+			return -1;
+		}
+		memcpy(s->held + s->held_len, premove, 5);
+		s->held_len += 5;
+		return 0;
+	}
+	return session_queue(s, premove, 5);
+}
+
+//Asks for a hint, the answer comes back as an 'E' message
+//Take in the session
+//returns 1 if it was queued, -1 if it isn't our turn or the connection failed
+int session_ask_hint(struct session * s)
+{
+	if (!s->my_turn)
+	{
+		return -1;
+	}
+	return session_queue(s, "? ", 2);
+}
@@ -0,0 +1,63 @@
+#ifndef PROG1_SESSION_H
+#define PROG1_SESSION_H
+
+/*------------------------------------------------------------------------
+* Client side of one game connection, shared by the interactive client
+* and the bots.
+*
+* The session never blocks. The front end calls session_read when the
+* socket is readable. The session buffers what arrived, splits it into
+* whole server messages and calls the front end's handler once for each
+* message with its status byte:
+*   'S' 'P' 'K' - game type, always first
+*   '2'         - you are player one, waiting for player two
+*   'Y' 'H'     - your turn / hold, board is in game_board
+*   'I'         - last move was invalid, still your turn
+*   'E'         - hint answer is in hint and hint_eval
+*   'R'         - premove matched but its reply in premove_failed was
+*                 illegal, your turn follows
+*   'W' 'L' 'T' - game over
+* Moves are queued with session_move and friends and sent as the socket
+* allows. The front end should watch for writability while out_len > 0.
+* The server drops premoves that reach it during our own turn, so ones
+* made then are held and sent after our move, again after each move
+* until the server takes one.
+*------------------------------------------------------------------------
+*/
+
+#define SESSION_IN_MAX 256 /* socket bytes buffered while a message completes */
+#define SESSION_OUT_MAX 64 /* bytes queued for the server */
+#define SESSION_HELD_MAX 40 /* premove bytes held back during our turn, 8 premoves */
+
+struct session;
+
+typedef void (*session_handler)(struct session * s, char status);
+
+struct session {
+	int sd;
+	session_handler handler;
+	void * user; /* front end's own data */
+	char game_type;
+	int player_number; /* 0 until known */
+	int my_turn; /* server is waiting on our move */
+	int over; /* got 'W', 'L' or 'T' */
+	char game_board[42];
+	char hint[2];
+	int hint_eval;
+	char premove_failed[2]; /* reply the server refused to play */
+	char in[SESSION_IN_MAX];
+	int in_len;
+	char out[SESSION_OUT_MAX];
+	int out_len;
+	char held[SESSION_HELD_MAX]; /* premoves to send after our move */
+	int held_len;
+};
+
+void session_init(struct session * s, int sd, session_handler handler, void * user);
+int session_read(struct session * s);
+int session_write(struct session * s);
+int session_move(struct session * s, char * move);
+int session_premove(struct session * s, char * premove);
+int session_ask_hint(struct session * s);
+
+#endif
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include "prog1_trace.h"
+
+__thread struct trace_ring trace_ring;
+volatile sig_atomic_t trace_requested;
+int trace_wake_fd = -1;
+
+static const char * trace_names[TRACE_KINDS] = {
+	"accept", "pair", "recv", "validate", "win check", "send queued", "send done", "turn"
+};
+
+static unsigned long long anchor_ticks; /* trace_now() at anchor_ns */
+static long long anchor_ns; /* CLOCK_MONOTONIC when the recorder started */
+static double ns_per_tick;
+static long long slow_ns; /* turns longer than this get dumped, 0 for never */
+static int auto_dumped; /* this process already dumped a slow turn */
+static int dumps; /* files written by this process */
+static const char * trace_dir; /* where dumps go, C4_TRACE_DIR or /tmp */
+
+//Reads CLOCK_MONOTONIC in nanoseconds
+static long long trace_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//SIGUSR1 handler, the process dumps its ring next time it's back in its loop
+static void trace_signal(int sig)
+{
+	int saved_errno = errno;
+	char byte = 0;
+
+	trace_requested = 1;
+	if (trace_wake_fd >= 0)
+	{
+		write(trace_wake_fd, &byte, 1);
+	}
+	errno = saved_errno;
+}
+
+//Starts the recorder, call once before any events
+//Works out how fast trace_now ticks, reads C4_TRACE_SLOW_US and takes SIGUSR1
+//returns nothing
+void trace_init(void)
+{
+	struct timespec pause = { 0, 10000000 }; /* 10ms to time the TSC against */
+	struct sigaction sa;
+	char * slow;
+
+	anchor_ns = trace_clock_ns();
+	anchor_ticks = trace_now();
+	nanosleep(&pause, NULL);
+	ns_per_tick = (double)(trace_clock_ns() - anchor_ns) / (double)(trace_now() - anchor_ticks);
+
+	slow = getenv("C4_TRACE_SLOW_US");
+	slow_ns = (slow != NULL) ? atoll(slow) * 1000LL : 50000000LL;
+	trace_dir = getenv("C4_TRACE_DIR");
+	if (trace_dir == NULL || trace_dir[0] == '\0')
+	{
+		trace_dir = "/tmp";
+	}
+
+	// Restart accept and friends, the loops that care are woken through trace_wake_fd
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = trace_signal;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &sa, NULL);
+}
+
+//Drops everything recorded before a mark, so a game child only keeps its own history
+//Take in a mark from trace_mark
+//returns nothing
+void trace_keep_from(unsigned long mark)
+{
+	trace_ring.first = mark;
+}
+
+//Records the end of a turn, and dumps the ring the first time a turn is slow
+//Take in when the turn started, 0 if it never did
+//returns nothing
+void trace_turn(unsigned long long started)
+{
+	unsigned long long now;
+	long long turn_ns;
+
+	if (started == 0)
+	{
+		return;
+	}
+	now = trace_now();
+	turn_ns = (long long)((now - started) * ns_per_tick);
+	trace_at(now, TRACE_TURN, 0, (int)(turn_ns / 1000));
+	if (slow_ns > 0 && turn_ns > slow_ns && !auto_dumped)
+	{
+		auto_dumped = 1;
+		trace_dump("slow turn");
+	}
+}
+
+//Dumps the ring if SIGUSR1 asked for it
+//returns nothing
+void trace_check(void)
+{
+	if (trace_requested)
+	{
+		trace_requested = 0;
+		trace_dump("SIGUSR1");
+	}
+}
+
+//Writes this thread's ring out as Chrome trace JSON
+//Timestamps are CLOCK_MONOTONIC microseconds so dumps from different processes line up
+//Take in why the dump was taken
+//returns 1 on success, -1 if the file couldn't be written
+int trace_dump(const char * reason)
+{
+	struct trace_event * e;
+	char path[512];
+	FILE * out;
+	int fd;
+	int tries;
+	unsigned long start;
+	unsigned long i;
+	long long now_ns;
+	unsigned long long now_ticks;
+	double rate = ns_per_tick;
+	double ts;
+	int tid;
+
+	// Time the TSC over the whole run once it has been long enough to beat the first guess
+	now_ns = trace_clock_ns();
+	now_ticks = trace_now();
+	if (now_ns - anchor_ns > 1000000000LL)
+	{
+		rate = (double)(now_ns - anchor_ns) / (double)(now_ticks - anchor_ticks);
+	}
+
+	// Always a new file of our own, never whatever someone left at the name in a shared dir
+	for (tries = 0; tries < 16; tries++)
+	{
+		snprintf(path, sizeof(path), "%s/c4trace-%d-%d.json", trace_dir, (int)getpid(), dumps++);
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+		if (fd >= 0 || errno != EEXIST)
+		{
+			break;
+		}
+	}
+	if (fd < 0 || (out = fdopen(fd, "w")) == NULL)
+	{
+		perror(path);
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		return -1;
+	}
+
+	tid = (int)syscall(SYS_gettid);
+	start = trace_ring.first;
+	if (trace_ring.head - start > TRACE_EVENTS)
+	{
+		start = trace_ring.head - TRACE_EVENTS; //older ones were overwritten
+	}
+	fprintf(out, "{\"traceEvents\":[\n");
+	for (i = start; i < trace_ring.head; i++)
+	{
+		e = &trace_ring.events[i & (TRACE_EVENTS - 1)];
+		ts = (anchor_ns + (long long)(e->ticks - anchor_ticks) * rate) / 1000.0;
+		if (e->kind == TRACE_TURN)
+		{
+			fprintf(out, "{\"name\":\"turn\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%d,\"pid\":%d,\"tid\":%d},\n",
+				ts - e->arg, e->arg, (int)getpid(), tid);
+		}
+		else
+		{
+			fprintf(out, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"player\":%d,\"arg\":%d}},\n",
+				trace_names[e->kind], ts, (int)getpid(), tid, e->player, e->arg);
+		}
+	}
+	fprintf(out, "{\"name\":\"dump\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"reason\":\"%s\"}}\n]}\n",
+		now_ns / 1000.0, (int)getpid(), tid, reason);
+	if (fclose(out) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+	printf("trace: wrote %s (%s)\n", path, reason);
+	fflush(stdout);
+	return 1;
+}
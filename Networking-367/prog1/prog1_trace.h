@@ -0,0 +1,106 @@
+#ifndef PROG1_TRACE_H
+#define PROG1_TRACE_H
+
+#include <signal.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/*------------------------------------------------------------------------
+* Flight recorder for the server.
+*
+* Every thread keeps a ring of its last TRACE_EVENTS timestamped events.
+* A game child starts with the lobby's ring, so its dump also has the
+* accepts and pairing that led to the game. Only the owning thread ever
+* writes or reads its ring, so recording is a TSC read and a store, no
+* locks or atomics.
+*
+* A ring is written out as Chrome trace JSON (chrome://tracing, Perfetto)
+* to <dir>/c4trace-<pid>-<n>.json, where dir is C4_TRACE_DIR or /tmp:
+*   - on SIGUSR1, by the lobby, a cluster node, the hint service or a
+*     game that gets it (hint connections don't check for it),
+*   - by a game whose turn took longer than C4_TRACE_SLOW_US
+*     microseconds (default 50000, 0 turns this off), once per game.
+* Each dump is a new file only the server's user can read. An existing
+* file or symlink at that name is skipped, never written through.
+*------------------------------------------------------------------------
+*/
+
+#define TRACE_EVENTS 4096 /* per thread, power of two */
+
+enum trace_kind {
+	TRACE_ACCEPT, /* player connected, player is 1 or 2 */
+	TRACE_PAIR, /* two players put in a game, arg is the game number */
+	TRACE_RECV, /* message read off the player's socket, arg is its first byte */
+	TRACE_VALIDATE, /* move checked and played, arg is apply_move's result */
+	TRACE_WIN_CHECK, /* arg is check_winner's result */
+	TRACE_SEND_QUEUED, /* about to send, arg is the status byte */
+	TRACE_SEND_DONE, /* send returned, arg is what it returned */
+	TRACE_TURN, /* move in to replies out, arg is the turn's length in us */
+	TRACE_KINDS
+};
+
+struct trace_event {
+	unsigned long long ticks;
+	short kind;
+	short player;
+	int arg;
+};
+
+struct trace_ring {
+	unsigned long head; /* events ever recorded */
+	unsigned long first; /* oldest event worth dumping */
+	struct trace_event events[TRACE_EVENTS];
+};
+
+extern __thread struct trace_ring trace_ring;
+extern volatile sig_atomic_t trace_requested; /* set by SIGUSR1 */
+extern int trace_wake_fd; /* SIGUSR1 writes a byte here to wake a poll loop, -1 for none */
+
+//Reads the recorder's clock
+//returns TSC ticks where there is one, nanoseconds otherwise
+static inline unsigned long long trace_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+//Records an event at a time already read with trace_now
+static inline void trace_at(unsigned long long ticks, int kind, int player, int arg)
+{
+	struct trace_event * e = &trace_ring.events[trace_ring.head & (TRACE_EVENTS - 1)];
+
+	e->ticks = ticks;
+	e->kind = (short)kind;
+	e->player = (short)player;
+	e->arg = arg;
+	trace_ring.head++;
+}
+
+//Records an event now
+static inline void trace(int kind, int player, int arg)
+{
+	trace_at(trace_now(), kind, player, arg);
+}
+
+//Marks where the ring is, see trace_keep_from
+static inline unsigned long trace_mark(void)
+{
+	return trace_ring.head;
+}
+
+void trace_init(void);
+void trace_keep_from(unsigned long mark);
+void trace_turn(unsigned long long started);
+int trace_dump(const char * reason);
+void trace_check(void);
+
+#endif